@@ -0,0 +1,27 @@
+// libargs: the parser compiled once, for programs built with
+// ARGS_SEPARATE_COMPILATION (see args.hpp).
+//
+//   c++ -std=c++11 -O2 -c args.cpp && ar rcs libargs.a args.o
+
+#if !defined(ARGS_SEPARATE_COMPILATION)
+#define ARGS_SEPARATE_COMPILATION 1
+#endif
+#define ARGS_IMPLEMENTATION 1
+#include "args.hpp"
+
+namespace args {
+
+#define ARGS_INSTANTIATE_ARGS(T) \
+    template class PosArg<T>; \
+    template class VarArg<T>; \
+    template class KVArg<T>; \
+    template class LazyKVArg<T>;
+ARGS_COMMON_TYPES(ARGS_INSTANTIATE_ARGS)
+#undef ARGS_INSTANTIATE_ARGS
+
+namespace detail {
+template bool parse_float<float>(StringView, float&);
+template bool parse_float<double>(StringView, double&);
+} // namespace detail
+
+} // namespace args
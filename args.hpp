@@ -2,18 +2,56 @@
 #pragma once
 
 
-#include <iostream>
+#include <istream>
+#include <ostream>
 #include <string>
 #include <map>
 #include <vector>
-#include <string>
 #include <cstdint>
 #include <sstream>
 #include <cstring>
 #include <cstdio>
+#include <cstdarg>
 #include <cassert>
 #include <utility>
 #include <type_traits>
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <memory>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#define ARGS_POSIX 1
+extern char** environ;
+#endif
+
+#if !defined(ARGS_NO_THREADS)
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ARGS_AVX2 1
+#define ARGS_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ARGS_SSE2 1
+#endif
 
 namespace args {
 
@@ -21,6 +59,32 @@ namespace args {
 // Helpers
 ////////////////////////////////////////////////////////////////////////////////
 
+#if __cplusplus >= 201402L
+#define ARGS_CONSTEXPR14 constexpr
+#else
+#define ARGS_CONSTEXPR14
+#endif
+
+// Define ARGS_SEPARATE_COMPILATION everywhere (and link libargs, built from
+// args.cpp) to compile the parser once instead of in every file that
+// includes this header. Only declarations are left here then, along with
+// extern templates for arguments of the common types (see
+// ARGS_COMMON_TYPES).
+#if defined(ARGS_SEPARATE_COMPILATION)
+#define ARGS_INLINE
+#if !defined(ARGS_IMPLEMENTATION)
+#define ARGS_DECLARE_ONLY 1
+#endif
+#else
+#define ARGS_INLINE inline
+#endif
+
+#if defined(__GNUC__)
+#define ARGS_PRINTF_FORMAT(fmt, first) __attribute__((format(printf, fmt, first)))
+#else
+#define ARGS_PRINTF_FORMAT(fmt, first)
+#endif
+
 #define panic(...) \
 do { \
     fprintf(stderr, __VA_ARGS__); \
@@ -29,6 +93,74 @@ do { \
 } while (0);
 
 
+namespace detail {
+
+inline unsigned ctz32(uint32_t x) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return (unsigned)idx;
+#else
+    return (unsigned)__builtin_ctz(x);
+#endif
+}
+
+// Index of the first byte where a and b differ, or n if they don't. Vector
+// width is picked at compile time; the tail (and everything, without SSE2)
+// is done a byte at a time.
+inline size_t mismatch(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+#if defined(ARGS_AVX2)
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        uint32_t ne = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+        if (ne) { return i + ctz32(ne); }
+    }
+#endif
+#if defined(ARGS_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        uint32_t ne = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xFFFF;
+        if (ne) { return i + ctz32(ne); }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (a[i] != b[i]) { return i; }
+    }
+    return n;
+}
+
+// First occurrence of ch in [p, end), or end.
+inline const char* find_char(const char* p, const char* end, char ch) {
+#if defined(ARGS_AVX2)
+    __m256i needle32 = _mm256_set1_epi8(ch);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t eq = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle32));
+        if (eq) { return p + ctz32(eq); }
+    }
+#endif
+#if defined(ARGS_SSE2)
+    __m128i needle16 = _mm_set1_epi8(ch);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        uint32_t eq = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle16));
+        if (eq) { return p + ctz32(eq); }
+    }
+#endif
+    for (; p != end; ++p) {
+        if (*p == ch) { return p; }
+    }
+    return end;
+}
+
+} // namespace detail
+
+
+// Non-owning view of a string. Lengths are computed once, when the view is
+// made, and never again.
 class StringView {
 public:
     StringView() = default;
@@ -39,16 +171,11 @@ public:
 
 
     StringView(const char* str, size_t off, size_t len=npos) 
-    : start(str + off), end(start + len) {
-        if (len == npos) {
-            end = str + strlen(str);
-        } else {
-            assert(len <= strlen(start) - off);
-        }
-    }
+    : start(str + off), end(start + (len == npos ? strlen(start) : len)) {}
 
     StringView(const std::string& str, size_t off, size_t len=npos)
     : start(str.c_str()+off), end(start + len) {
+        assert(off <= str.size());
         if (len == npos) {
             end = str.c_str() + str.size();
         } else {
@@ -58,59 +185,67 @@ public:
 
 
     StringView(const StringView&) = default;
+    StringView& operator=(const StringView&) = default;
 
     StringView(const StringView sv, size_t off, size_t len=npos) {
         *this = sv.substr(off, len);
     }
 
+    // View of [_start, _end); doesn't need to be null terminated.
+    static StringView from_range(const char* _start, const char* _end) {
+        StringView sv;
+        sv.start = _start;
+        sv.end = _end;
+        return sv;
+    }
+
     StringView substr(size_t off, size_t len=npos) const {
-        assert(start + off + len <= end);
-        return StringView(start, off, len);
+        assert(off <= size());
+        if (len == npos) {
+            len = size() - off;
+        }
+        assert(len <= size() - off);
+        return from_range(start + off, start + off + len);
     }
 
     size_t size() const { return (size_t)(end - start); }
+    const char* data() const { return start; }
 
     bool operator==(const StringView& rhs) const {
-        return this->compare(rhs) == 0;
+        return size() == rhs.size() 
+            && detail::mismatch(start, rhs.start, size()) == size();
     }
 
     bool operator!=(const StringView& rhs) const {
-        return this->compare(rhs) != 0;
+        return !(*this == rhs);
     }
 
+    // Orders by the first differing byte; if one is a prefix of the other,
+    // the shorter one is greater.
     int compare(const StringView& rhs) const {
-        for (size_t i = 0; i <= size(); ++i) {
-
-            // Got to the end of both -> equal
-            if (i == this->size() && i == rhs.size()) {
-                return 0;
-
-            // lhs finished first -> lhs is greater
-            } else if (i == this->size()) {
-                return 1;
-
-            // lhs finished first -> rhs is greater
-            } else if (i == rhs.size()) {
-                return -1;
-            } 
+        size_t n = std::min(size(), rhs.size());
+        size_t i = detail::mismatch(start, rhs.start, n);
+        if (i < n) {
+            return start[i] - rhs.start[i];
+        }
 
-            auto diff = this->at(i) - rhs[i];
-            if (diff != 0) {
-                return diff;
-            }
+        if (size() == rhs.size()) {
+            return 0;
         }
+        return size() < rhs.size() ? 1 : -1;
+    }
 
-        panic("Unreachable");
+    bool starts_with(const StringView& prefix) const {
+        return size() >= prefix.size()
+            && detail::mismatch(start, prefix.start, prefix.size()) == prefix.size();
     }
 
-    // I should write something more general, but this is enough for now...
     size_t find(char ch, size_t off=0) const {
-        auto* p = start + off;
-        while (p != end) {
-            if (*p == ch) { return (size_t)(p - start); }
-            ++p;
+        if (off >= size()) {
+            return npos;
         }
-        return npos;
+        auto* p = detail::find_char(start + off, end, ch);
+        return p == end ? npos : (size_t)(p - start);
     }
 
     char operator[](size_t idx) const {
@@ -128,13 +263,7 @@ public:
     }
 
     friend std::ostream& operator<<(std::ostream& os, const StringView& sv) {
-        auto* p = sv.start;
-        while (p != sv.end) {
-            os << *p;
-            ++p;
-        }
-
-        return os;
+        return os.write(sv.start, (std::streamsize)sv.size());
     }
 
     static const size_t npos = (size_t)-1;
@@ -158,68 +287,141 @@ private:
 };
 
 
-////////////////////////////////////////////////////////////////////////////////
-// Forward declarations
-////////////////////////////////////////////////////////////////////////////////
-class KVArgBase;
-class PosArgBase;
-class FlagArg;
-class VarArgBase;
-
-class ParserBase {
-public:
-    virtual ~ParserBase() {}
-    virtual void add_pos_arg(PosArgBase *pos_arg) = 0;
-    virtual void add_kv_arg(KVArgBase *kv_arg) = 0;
-    virtual void add_flag_arg(FlagArg *flag_arg) = 0;
-    virtual void add_vararg(VarArgBase* vararg) = 0;
-};
+namespace detail {
 
+inline bool equal_ignore_case(StringView a, StringView b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        char x = a[i], y = b[i];
+        if (x >= 'A' && x <= 'Z') { x = (char)(x - 'A' + 'a'); }
+        if (y >= 'A' && y <= 'Z') { y = (char)(y - 'A' + 'a'); }
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
 
-////////////////////////////////////////////////////////////////////////////////
-// Argument classes
-////////////////////////////////////////////////////////////////////////////////
-class ArgBase {
+// Levenshtein distance from one pattern of up to 64 bytes to many strings,
+// with Myers' bit-parallel algorithm (in Hyyro's formulation): one column of
+// the DP table is two 64-bit vectors of +1/-1 deltas, so each byte of text
+// costs a handful of word operations.
+class EditDistance {
 public:
-    ArgBase(const char* _name, const char *_desc) 
-    : name(_name), desc(_desc) {}
+    static constexpr size_t max_pattern = 64;
 
-    virtual ~ArgBase() {}
+    // pattern must be no longer than max_pattern
+    explicit EditDistance(StringView pattern) : m(pattern.size()) {
+        memset(peq, 0, sizeof(peq));
+        for (size_t i = 0; i < m; i++) {
+            peq[(uint8_t)pattern[i]] |= (uint64_t)1 << i;
+        }
+    }
 
-    const char *get_desc() const { return desc; }
-    const char *get_name() const { return name; }
+    // The distance to text, or some value over max once it's certain to be
+    // over max
+    size_t distance(StringView text, size_t max) const {
+        size_t n = text.size();
+        if ((m > n ? m - n : n - m) > max) {
+            return max + 1;
+        }
+        if (m == 0) {
+            return n;
+        }
 
-    bool found() const { return was_found; }
-    operator bool() const { return found(); }
+        uint64_t last = (uint64_t)1 << (m - 1);
+        uint64_t pv = ~(uint64_t)0;
+        uint64_t mv = 0;
+        size_t score = m;
+        for (size_t j = 0; j < n; j++) {
+            uint64_t eq = peq[(uint8_t)text[j]];
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & last) {
+                score++;
+            } else if (mh & last) {
+                score--;
+            }
+            // Each of the remaining bytes can lower the score by at most one
+            if (score > max + (n - j - 1)) {
+                return max + 1;
+            }
+            // The top row of the table counts up, so it shifts in a +1
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return score;
+    }
 
-protected:
-    bool was_found = false;
-    const char *name;
-    const char *desc;
+private:
+    size_t m;
+    uint64_t peq[256];
 };
 
+// Keeps the candidates closest to a pattern by edit distance, closest first
+// (earliest first on a tie), in caller-provided storage. Candidates more
+// than half the pattern's length away (at least 1, at most 3) are dropped,
+// and so is everything for a pattern EditDistance can't take.
+class Nearest {
+public:
+    static constexpr size_t max_out = 8;
 
+    Nearest(StringView pattern, StringView* _out, size_t _max)
+    : ed(pattern.size() <= EditDistance::max_pattern ? pattern : StringView()),
+      out(_out), max(pattern.size() <= EditDistance::max_pattern ? std::min<size_t>(_max, 8) : 0),
+      limit(std::min<size_t>(3, std::max<size_t>(1, pattern.size() / 2))) {}
 
-class PosArgBase : public ArgBase {
-public:
-    PosArgBase(ParserBase& parser, const char* _name, const char *_desc) 
-    : ArgBase(_name, _desc) {
-        parser.add_pos_arg(this);
+    void consider(StringView candidate) {
+        if (max == 0) {
+            return;
+        }
+        // Once out is full, only something strictly closer gets in
+        size_t bound = found == max ? dists[found - 1] - 1 : limit;
+        if (bound == (size_t)-1) {
+            return;
+        }
+        size_t d = ed.distance(candidate, bound);
+        if (d > bound) {
+            return;
+        }
+        size_t i = found < max ? found++ : found - 1;
+        for (; i > 0 && dists[i - 1] > d; i--) {
+            out[i] = out[i - 1];
+            dists[i] = dists[i - 1];
+        }
+        out[i] = candidate;
+        dists[i] = d;
     }
 
-    virtual bool parse(StringView str) = 0;
+    size_t count() const { return found; }
+
+private:
+    EditDistance ed;
+    StringView* out;
+    size_t max;
+    size_t limit;
+    size_t found = 0;
+    size_t dists[max_out];
 };
 
-template<typename T>
-class PosArg : public PosArgBase {
-public:
-    PosArg(ParserBase& parser, const char* _name, const char *_desc) 
-    : PosArgBase(parser, _name, _desc) {}
+} // namespace detail
 
 
-    bool parse(StringView str) override {
-        was_found = true;
+////////////////////////////////////////////////////////////////////////////////
+// Value conversion
+////////////////////////////////////////////////////////////////////////////////
 
+// Fallback for types without a Converter specialization: reads the value with
+// operator>> and requires that the whole string was consumed.
+template<typename T>
+struct IStreamConverter {
+    static bool parse(StringView str, T& val) {
         auto buf = str.read_buf();
         std::istream is(&buf);
         assert(is);
@@ -230,626 +432,5293 @@ public:
         }
 
         is.peek();
-        if (!is.eof()) { 
-            return false;
-        }
-
-        return true;
+        return is.eof();
     }
+};
 
+// Turns the text of an argument into a T. Specialize this for your own types
+// (a static bool parse(StringView, T&)) to bypass the istream fallback.
+template<typename T, typename Enable=void>
+struct Converter : IStreamConverter<T> {};
 
-    const T& value() const {
-        assert(was_found);
-        return val;
-    }
 
-    const T& operator*() const {
-        return value();
+// A StringView (or std::string_view) borrows the argument's text: no copy
+// and no allocation, but the text must outlive the argument. That holds for
+// argv, BufferSource and response files (until the ParseState is reset), not
+// for FdSource.
+template<>
+struct Converter<StringView> {
+    static bool parse(StringView str, StringView& val) {
+        val = str;
+        return true;
     }
-
-private:
-    T val{};
 };
 
-
-class VarArgBase : public ArgBase {
-public:
-    VarArgBase(ParserBase& parser, const char* _name, const char *_desc) 
-    : ArgBase(_name, _desc) {
-        parser.add_vararg(this);
+#if __cplusplus >= 201703L
+template<>
+struct Converter<std::string_view> {
+    static bool parse(StringView str, std::string_view& val) {
+        val = std::string_view(str.data(), str.size());
+        return true;
+    }
+};
+#endif
+
+// Copies the whole text, spaces and all (operator>> would stop at the first
+// space and so reject the value).
+template<>
+struct Converter<std::string> {
+    static bool parse(StringView str, std::string& val) {
+        val.assign(str.data(), str.size());
+        return true;
     }
-
-    virtual bool parse(StringView str) = 0;
 };
 
 
-template<typename T>
-class VarArg : public VarArgBase {
-    // To prevent confusion with operator bool
-    static_assert(!std::is_same<T, bool>::value, "Use FlagArg for bool");
+namespace detail {
 
-public:
-    VarArg(ParserBase& parser, const char* _name, const char *_desc) 
-    : VarArgBase(parser, _name, _desc) {}
+template<typename T>
+struct is_char_type : std::integral_constant<bool,
+    std::is_same<T, char>::value || std::is_same<T, wchar_t>::value
+    || std::is_same<T, char16_t>::value || std::is_same<T, char32_t>::value> {};
 
-    bool parse(StringView str) override {
-        was_found = true;
+// Character types keep reading a single character through the istream
+// fallback, and bool keeps istream's 0/1 handling. signed/unsigned char are
+// treated as numbers so int8_t and uint8_t behave like the other widths.
+template<typename T>
+struct is_converted_integer : std::integral_constant<bool,
+    std::is_integral<T>::value && !std::is_same<T, bool>::value
+    && !is_char_type<T>::value> {};
+
+inline unsigned digit_value(char c) {
+    if (c >= '0' && c <= '9') { return (unsigned)(c - '0'); }
+    if (c >= 'a' && c <= 'z') { return (unsigned)(c - 'a') + 10; }
+    if (c >= 'A' && c <= 'Z') { return (unsigned)(c - 'A') + 10; }
+    return 36;
+}
 
-        auto buf = str.read_buf();
-        std::istream is(&buf);
-        assert(is);
+// Splits an optionally signed integer with an optional 0x/0o/0b prefix into
+// its sign and magnitude. Fails on empty input, stray characters and
+// magnitudes that don't fit in an unsigned long long.
+inline bool parse_integer(StringView str, bool& neg, unsigned long long& mag) {
+    const char* p = str.data();
+    const char* end = p + str.size();
+
+    neg = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+        neg = *p == '-';
+        ++p;
+    }
 
-        T val{};
-        is >> val;
-        if (!is) { 
-            return false; 
+    unsigned base = 10;
+    if (end - p > 2 && p[0] == '0') {
+        switch (p[1]) {
+            case 'x': case 'X': base = 16; p += 2; break;
+            case 'o': case 'O': base = 8; p += 2; break;
+            case 'b': case 'B': base = 2; p += 2; break;
+            default: break;
         }
+    }
 
-        is.peek();
-        if (!is.eof()) { 
+    if (p == end) {
+        return false;
+    }
+
+    const unsigned long long max = std::numeric_limits<unsigned long long>::max();
+    const unsigned long long cutoff = max / base;
+    const unsigned cutlim = (unsigned)(max % base);
+
+    mag = 0;
+    for (; p != end; ++p) {
+        unsigned digit = digit_value(*p);
+        if (digit >= base) {
             return false;
         }
-
-        vals.push_back(val);
-        return true;
+        if (mag > cutoff || (mag == cutoff && digit > cutlim)) {
+            return false;
+        }
+        mag = mag * base + digit;
     }
 
-    const std::vector<T>& value() const {
-        return vals;
+    return true;
+}
+
+template<typename T>
+typename std::enable_if<std::is_signed<T>::value, bool>::type
+narrow_integer(bool neg, unsigned long long mag, T& val) {
+    const unsigned long long max = (unsigned long long)std::numeric_limits<T>::max();
+    if (!neg) {
+        if (mag > max) { return false; }
+        val = (T)mag;
+    } else {
+        if (mag > max + 1) { return false; }
+        val = mag == max + 1 ? std::numeric_limits<T>::min() : (T)-(T)mag;
     }
+    return true;
+}
 
-    const std::vector<T>& operator*() const {
-        return value();
+template<typename T>
+typename std::enable_if<std::is_unsigned<T>::value, bool>::type
+narrow_integer(bool neg, unsigned long long mag, T& val) {
+    if ((neg && mag != 0) || mag > (unsigned long long)std::numeric_limits<T>::max()) {
+        return false;
     }
+    val = (T)mag;
+    return true;
+}
 
-private:
-    std::vector<T> vals;
-};
+} // namespace detail
 
 
-class KVArgBase : public ArgBase {
-public:
-    KVArgBase(ParserBase& parser, const char* _k, const char* _short_k, const char* _desc) 
-    : ArgBase(_k, _desc), k(_k), short_k(_short_k) {
-        parser.add_kv_arg(this);
+template<typename T>
+struct Converter<T, typename std::enable_if<detail::is_converted_integer<T>::value>::type> {
+    static bool parse(StringView str, T& val) {
+        bool neg;
+        unsigned long long mag;
+        if (!detail::parse_integer(str, neg, mag)) {
+            return false;
+        }
+        return detail::narrow_integer(neg, mag, val);
     }
+};
 
-    virtual bool parse(StringView str) = 0;
 
-    const char* get_key() const { return k; }
-    const char* get_short_key() const { return short_k; }
 
-protected:
-    const char* k;
-    const char* short_k;   
+namespace detail {
+
+template<typename T> struct FloatTraits;
+
+template<> struct FloatTraits<double> {
+    typedef uint64_t Bits;
+    static const int mant_bits = 52;
+    static const int exp_bits = 11;
+    static const int bias = -1023;
+    static const int max_fast_exp10 = 22;
+
+    static double pow10(int i) {
+        static const double table[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        return table[i];
+    }
 };
 
+template<> struct FloatTraits<float> {
+    typedef uint32_t Bits;
+    static const int mant_bits = 23;
+    static const int exp_bits = 8;
+    static const int bias = -127;
+    static const int max_fast_exp10 = 10;
+
+    static float pow10(int i) {
+        static const float table[] = {
+            1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+        };
+        return table[i];
+    }
+};
 
 template<typename T>
-class KVArg : public KVArgBase {
-    // To prevent confusion with operator bool
-    static_assert(!std::is_same<T, bool>::value, "Use FlagArg for bool");
-public:
-    KVArg(ParserBase& parser, const char* _k, const char* _short_k, const char* _desc)
-    : KVArgBase(parser, _k, _short_k, _desc) { }
+struct is_converted_float : std::integral_constant<bool,
+    std::is_same<T, float>::value || std::is_same<T, double>::value> {};
 
-    bool parse(StringView str) override {
-        was_found = true;
-
-        auto buf = str.read_buf();
-        std::istream is(&buf);
-        assert(is);
+#if !defined(ARGS_DECLARE_ONLY)
 
-        is >> val;
-        if (!is) { 
-            return false; 
-        }
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
 
-        is.peek();
-        if (!is.eof()) { 
-            return false;
-        }
+// Case-insensitive match of the whole of [p, end) against a lowercase word.
+inline bool matches_word(const char* p, const char* end, const char* word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - p) != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char c = p[i];
+        if (c >= 'A' && c <= 'Z') { c = (char)(c - 'A' + 'a'); }
+        if (c != word[i]) { return false; }
+    }
+    return true;
+}
 
-        return true;
+// Reads the digits of a (possibly signed) decimal exponent, saturating well
+// beyond any representable exponent.
+inline bool parse_exponent(const char*& p, const char* end, long& exp) {
+    bool neg = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+        neg = *p == '-';
+        ++p;
+    }
+    if (p == end || !is_digit(*p)) {
+        return false;
     }
+    exp = 0;
+    for (; p != end && is_digit(*p); ++p) {
+        if (exp < 100000) { exp = exp * 10 + (*p - '0'); }
+    }
+    if (neg) { exp = -exp; }
+    return true;
+}
 
 
-    const T& value() const {
-        assert(was_found);
-        return val;
+// Arbitrary precision decimal used by the slow path. This is the "simple
+// decimal conversion" algorithm (as in Go's strconv): the value is scaled
+// into [0.5, 1) by exact binary shifts of the decimal digits, then the
+// mantissa bits are shifted out and rounded half to even. It is exact for
+// every input, at the cost of being much slower than the fast path.
+struct Decimal {
+    static const int max_digits = 800;
+    static const int max_shift = 60;
+
+    uint8_t d[max_digits];
+    int nd = 0;             // Number of digits used
+    int dp = 0;             // Decimal point
+    bool trunc = false;     // Discarded nonzero digits beyond d[0, nd)
+
+    void load(const char* int_begin, const char* int_end,
+              const char* frac_begin, const char* frac_end, long exp) {
+        while (int_begin != int_end && *int_begin == '0') { ++int_begin; }
+        for (const char* p = int_begin; p != int_end; ++p) {
+            push(*p);
+        }
+        dp = (int)(int_end - int_begin);
+        for (const char* p = frac_begin; p != frac_end; ++p) {
+            if (*p == '0' && nd == 0) {
+                dp--;
+                continue;
+            }
+            push(*p);
+        }
+        dp += (int)exp;
+        trim();
     }
 
-    const T& value_or(T def) const {
-        return was_found ? val : def;
+    void push(char c) {
+        if (c == '0' && nd == 0) {
+            return;
+        }
+        if (nd < max_digits) {
+            d[nd++] = (uint8_t)(c - '0');
+        } else if (c != '0') {
+            trunc = true;
+        }
     }
 
-    const T& operator*() const {
-        return value();
+    void trim() {
+        while (nd > 0 && d[nd - 1] == 0) { nd--; }
+        if (nd == 0) { dp = 0; }
     }
 
-private:
-    T val{};
-};
+    void right_shift(unsigned k) {
+        int r = 0;
+        int w = 0;
+        uint64_t n = 0;
 
+        for (; (n >> k) == 0; r++) {
+            if (r >= nd) {
+                if (n == 0) {
+                    nd = 0;
+                    return;
+                }
+                while ((n >> k) == 0) {
+                    n *= 10;
+                    r++;
+                }
+                break;
+            }
+            n = n * 10 + d[r];
+        }
+        dp -= r - 1;
+
+        const uint64_t mask = ((uint64_t)1 << k) - 1;
+        for (; r < nd; r++) {
+            uint64_t dig = n >> k;
+            n &= mask;
+            d[w++] = (uint8_t)dig;
+            n = n * 10 + d[r];
+        }
 
+        while (n > 0) {
+            uint64_t dig = n >> k;
+            n &= mask;
+            if (w < max_digits) {
+                d[w++] = (uint8_t)dig;
+            } else if (dig > 0) {
+                trunc = true;
+            }
+            n *= 10;
+        }
 
-class FlagArg : public ArgBase {
-public:
-    FlagArg(ParserBase& parser, const char* _k, const char* _short_k, const char *_desc) 
-    : ArgBase(_k, _desc), k(_k), short_k(_short_k) {
-        parser.add_flag_arg(this);
+        nd = w;
+        trim();
     }
 
-    void parse() {
-        was_found = true;
+    void left_shift(unsigned k) {
+        // Produce the digits of the product right to left into a scratch
+        // buffer, then copy back; k <= 60 adds at most 19 digits.
+        uint8_t tmp[max_digits + 20];
+        int w = max_digits + 20;
+        uint64_t n = 0;
+
+        for (int r = nd - 1; r >= 0; r--) {
+            n += (uint64_t)d[r] << k;
+            uint64_t quo = n / 10;
+            tmp[--w] = (uint8_t)(n - 10 * quo);
+            n = quo;
+        }
+        while (n > 0) {
+            uint64_t quo = n / 10;
+            tmp[--w] = (uint8_t)(n - 10 * quo);
+            n = quo;
+        }
+
+        int count = max_digits + 20 - w;
+        dp += count - nd;
+        if (count > max_digits) {
+            for (int i = w + max_digits; i < max_digits + 20; i++) {
+                if (tmp[i] != 0) { trunc = true; }
+            }
+            count = max_digits;
+        }
+        memcpy(d, tmp + w, (size_t)count);
+        nd = count;
+        trim();
     }
 
-    bool value() const {
-        return was_found;
+    void shift(int k) {
+        if (nd == 0) {
+            return;
+        }
+        for (; k > max_shift; k -= max_shift) { left_shift(max_shift); }
+        for (; k < -max_shift; k += max_shift) { right_shift(max_shift); }
+        if (k > 0) {
+            left_shift((unsigned)k);
+        } else if (k < 0) {
+            right_shift((unsigned)-k);
+        }
     }
 
-    bool operator*() const {
-        return value();
+    bool should_round_up(int i) const {
+        if (i < 0 || i >= nd) {
+            return false;
+        }
+        // Exactly halfway: round to even
+        if (d[i] == 5 && i + 1 == nd) {
+            return trunc || (i > 0 && d[i - 1] % 2 == 1);
+        }
+        return d[i] >= 5;
     }
 
-    const char* get_key() const { return k; }
-    const char* get_short_key() const { return short_k; }
-
-protected:
-    const char* k;
-    const char* short_k;
-};
-
+    uint64_t rounded_integer() const {
+        if (dp > 20) {
+            return (uint64_t)-1;
+        }
+        int i = 0;
+        uint64_t n = 0;
+        for (; i < dp && i < nd; i++) { n = n * 10 + d[i]; }
+        for (; i < dp; i++) { n *= 10; }
+        if (should_round_up(dp)) { n++; }
+        return n;
+    }
 
+    // Returns false on overflow.
+    template<typename T>
+    bool to_float(T& val) {
+        typedef FloatTraits<T> F;
+        typedef typename F::Bits Bits;
+        static const int powtab[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+        static const int npowtab = (int)(sizeof(powtab) / sizeof(powtab[0]));
+        const int max_biased = (1 << F::exp_bits) - 1;
 
+        Bits mant = 0;
+        int exp = F::bias;
 
+        if (nd != 0 && dp > 310) {
+            return false;
+        }
 
-////////////////////////////////////////////////////////////////////////////////
-// Parser 
-////////////////////////////////////////////////////////////////////////////////
+        if (nd != 0 && dp >= -330) {
+            exp = 0;
+            while (dp > 0) {
+                int n = dp >= npowtab ? 27 : powtab[dp];
+                shift(-n);
+                exp += n;
+            }
+            while (dp < 0 || (dp == 0 && nd > 0 && d[0] < 5)) {
+                int n = -dp >= npowtab ? 27 : powtab[-dp];
+                shift(n);
+                exp -= n;
+            }
 
-const char* status_str[] = {
-    "SUCCESS",
-    "INVALID_KEY",
-    "MISSING_VALUE",
-    "EXTRA_VALUE",
-    "ISTREAM_ERROR",
-    "IS_FLAG",
-    "MISSING_ARG",
-    "EXTRA_ARG",
-    "HELP"
-};
+            // Now in [0.5, 1), but the float's range is [1, 2)
+            exp--;
 
-enum class Status {
-    SUCCESS = 0,
-    INVALID_KEY,
-    MISSING_VALUE,
-    EXTRA_VALUE,
-    ISTREAM_ERROR,
-    IS_FLAG,
-    MISSING_ARG,
-    EXTRA_ARG,
-    HELP
-};
+            if (exp < F::bias + 1) {
+                int n = F::bias + 1 - exp;
+                shift(-n);
+                exp += n;
+            }
+            if (exp - F::bias >= max_biased) {
+                return false;
+            }
 
-static inline std::ostream& operator<<(std::ostream& os, Status s) {
-    os << status_str[(int)s];
-    return os;
-}
+            shift(1 + F::mant_bits);
+            uint64_t m = rounded_integer();
 
-struct Result {
-    Status status;
-    std::string item;
+            // Rounding carried into a new bit
+            if (m == ((uint64_t)2 << F::mant_bits)) {
+                m >>= 1;
+                exp++;
+                if (exp - F::bias >= max_biased) {
+                    return false;
+                }
+            }
 
-    explicit Result(Status _status, const std::string& _item) : status(_status), item(_item) {}
-    explicit Result(Status _status, const char* _item) : status(_status), item(_item) {}
-    explicit Result(Status _status, char _item) : status(_status), item(1,_item) {}
+            // Subnormal
+            if ((m & ((uint64_t)1 << F::mant_bits)) == 0) {
+                exp = F::bias;
+            }
+            mant = (Bits)m;
+        }
 
-    operator bool() { return status == Status::SUCCESS; }
+        Bits bits = mant & (((Bits)1 << F::mant_bits) - 1);
+        bits |= (Bits)((exp - F::bias) & max_biased) << F::mant_bits;
+        memcpy(&val, &bits, sizeof(val));
+        return true;
+    }
 };
 
 
+// Rounds mant * 2^exp2 (plus a sticky bit for discarded nonzero digits) to
+// the nearest T, ties to even. Returns false on overflow.
+template<typename T>
+bool make_float(uint64_t mant, long exp2, bool sticky, T& val) {
+    typedef FloatTraits<T> F;
+
+    if (mant == 0) {
+        val = 0;
+        return true;
+    }
 
+    int msb = 63;
+    while (!(mant >> msb)) { msb--; }
 
-class Parser : public ParserBase {
-public:
-    Parser(const char* _app_name, int argc, const char **argv, bool _silent=false) 
-    : app_name(_app_name), silent(_silent) {
-        for (int i=1; i<argc; i++) { args.emplace_back(argv[i]); }
+    const long min_exp = F::bias + 1;
+    const long max_exp = -F::bias;
+    long top = msb + exp2;
+    if (top > max_exp) {
+        return false;
     }
 
-// Adding arguments
-//////////////////////////////////////////////////////////////////////////////
-    void add_pos_arg(PosArgBase *pos_arg) override {
-        if (vararg) {
-            panic("Parser config error: config %s: can't have positional argument after vararg", pos_arg->get_name());
-        }
-        pos_args.push_back(pos_arg);
+    long prec = F::mant_bits + 1;
+    if (top < min_exp) {
+        prec -= min_exp - top;
     }
 
-    void add_vararg(VarArgBase *_vararg) override {
-        if (vararg) {
-            panic("Parser config error: config %s: can't have more than one vararg", _vararg->get_name());
+    long drop = msb + 1 - prec;
+    if (drop > 64) {
+        val = 0;
+        return true;
+    } else if (drop > 0) {
+        uint64_t kept = drop == 64 ? 0 : mant >> drop;
+        uint64_t rem = drop == 64 ? mant : mant & (((uint64_t)1 << drop) - 1);
+        uint64_t half = (uint64_t)1 << (drop - 1);
+        if (rem > half || (rem == half && (sticky || (kept & 1)))) {
+            kept++;
         }
-        vararg = _vararg;
+        mant = kept;
+        exp2 += drop;
     }
 
-    void add_kv_arg(KVArgBase *kv_arg) override {
-        StringView k = kv_arg->get_key();
-        StringView short_k = kv_arg->get_short_key();
+    val = std::ldexp((T)mant, (int)exp2);
+    return !std::isinf(val);
+}
 
-        if (k == "help") {
-            panic("Parser config error: config %s's key cannot be \"help\" (configs with builtin help flag", kv_arg->get_name());
+// Hex float body after the "0x": hex digits with an optional point and an
+// optional binary exponent ("p-3").
+template<typename T>
+bool parse_hex_float(const char* p, const char* end, T& val) {
+    uint64_t mant = 0;
+    long exp2 = 0;
+    bool sticky = false;
+    bool any = false;
+
+    for (; p != end && digit_value(*p) < 16; ++p) {
+        any = true;
+        if ((mant >> 60) == 0) {
+            mant = mant * 16 + digit_value(*p);
+        } else {
+            exp2 += 4;
+            sticky |= *p != '0';
         }
+    }
 
-        if (short_k == "h") {
-            panic("Parser config error: config %s's short key cannot be \"h\" (configs with builtin help flag", kv_arg->get_name());
+    if (p != end && *p == '.') {
+        ++p;
+        for (; p != end && digit_value(*p) < 16; ++p) {
+            any = true;
+            if ((mant >> 60) == 0) {
+                mant = mant * 16 + digit_value(*p);
+                exp2 -= 4;
+            } else {
+                sticky |= *p != '0';
+            }
         }
+    }
 
-        if (k.size() == 0) {
-            panic("Parser config error: config %s's key cannot be empty", kv_arg->get_name());
-        }
+    if (!any) {
+        return false;
+    }
 
-        if (k.find('=') != StringView::npos) {
-            panic("Parser config error: config %s's key cannot contain \"=\"", kv_arg->get_name());
+    if (p != end && (*p == 'p' || *p == 'P')) {
+        ++p;
+        long e;
+        if (!parse_exponent(p, end, e)) {
+            return false;
         }
+        exp2 += e;
+    }
 
-        // kv_keys.push_back(kv_arg);
+    if (p != end) {
+        return false;
+    }
 
-        if (kv_keys.count(k) != 0 || flag_keys.count(k) != 0) {
-            panic("Parser config error: config %s's long key is a duplicate", kv_arg->get_name());
-        }
-        kv_keys[k] = kv_arg;
+    return make_float(mant, exp2, sticky, val);
+}
 
-        if (short_k != "") {
-            if (short_k.size() > 1) {
-                panic("Parser config error: config %s's short key %s is %zu characters; A short key must be zero characters (no short key) or one character", kv_arg->get_name(), short_k.str().c_str(), short_k.size());
-            }
-            char c = short_k[0];
-            if (kv_short_keys.count(c) != 0 || flag_short_keys.count(c) != 0) {
-                panic("Parser config error: config %s's short key %c is a duplicate", kv_arg->get_name(), c);
-            }
-            kv_short_keys[c] = kv_arg;
-        }
+// 64x64 -> 128 bit multiply
+inline void mul64(uint64_t a, uint64_t b, uint64_t& hi, uint64_t& lo) {
+#if defined(__SIZEOF_INT128__)
+    __extension__ typedef unsigned __int128 u128;
+    u128 r = (u128)a * b;
+    hi = (uint64_t)(r >> 64);
+    lo = (uint64_t)r;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi, hl = a_hi * b_lo, hh = a_hi * b_hi;
+    uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+    hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    lo = (mid << 32) | (uint32_t)ll;
+#endif
+}
 
+// 128-bit mantissas of 10^q, normalized so the top bit is set and rounded
+// down, for the Eisel-Lemire multiply. Rather than carry a 700-line literal
+// table in the header, it's computed exactly with a little fixed-size bignum
+// the first time a float misses Clinger's fast path.
+struct PowersOfTen {
+    static const int min_exp10 = -348;
+    static const int max_exp10 = 347;
+    static const int count = max_exp10 - min_exp10 + 1;
+
+    uint64_t hi[count];
+    uint64_t lo[count];
+
+    static const PowersOfTen& get() {
+        static const PowersOfTen table;
+        return table;
     }
 
+private:
+    // Little-endian base 2^32; 2^1024 is the largest value needed.
+    struct Big {
+        static const int max_words = 34;
+        uint32_t w[max_words];
+        int n;
+
+        bool bit(int i) const { return (w[i / 32] >> (i % 32)) & 1; }
+
+        int bit_length() const {
+            int top = n - 1;
+            while (top > 0 && w[top] == 0) { top--; }
+            int len = top * 32;
+            for (uint32_t x = w[top]; x; x >>= 1) { len++; }
+            return len;
+        }
 
-    void add_flag_arg(FlagArg *flag_arg) override {
-        StringView k = flag_arg->get_key();
-        StringView short_k = flag_arg->get_short_key();
+        void mul_small(uint32_t m) {
+            uint64_t carry = 0;
+            for (int i = 0; i < n; i++) {
+                uint64_t t = (uint64_t)w[i] * m + carry;
+                w[i] = (uint32_t)t;
+                carry = t >> 32;
+            }
+            if (carry) { w[n++] = (uint32_t)carry; }
+        }
 
-        if (k.size() == 0) {
-            panic("Parser config error: config %s's key cannot be empty", flag_arg->get_name());
+        void div_small(uint32_t d) {
+            uint64_t rem = 0;
+            for (int i = n - 1; i >= 0; i--) {
+                uint64_t t = (rem << 32) | w[i];
+                w[i] = (uint32_t)(t / d);
+                rem = t % d;
+            }
         }
 
-        // flag_keys.push_back(flag_arg);
+        // Top 128 bits, shifted up if the value is shorter than that
+        void top128(uint64_t& h, uint64_t& l) const {
+            int len = bit_length();
+            h = l = 0;
+            for (int i = 0; i < 128; i++) {
+                int src = len - 1 - i;
+                uint64_t b = src >= 0 && bit(src) ? 1 : 0;
+                if (i < 64) {
+                    h |= b << (63 - i);
+                } else {
+                    l |= b << (127 - i);
+                }
+            }
+        }
+    };
 
-        if (flag_keys.count(k) != 0 || kv_keys.count(k) != 0) {
-            panic("Parser config error: config %s's key is a duplicate", flag_arg->get_name());
+    PowersOfTen() {
+        // 10^q has the same normalized mantissa as 5^q.
+        Big big;
+        big.n = 1;
+        big.w[0] = 1;
+        for (int q = 0; q <= max_exp10; q++) {
+            if (q > 0) { big.mul_small(5); }
+            big.top128(hi[q - min_exp10], lo[q - min_exp10]);
         }
-        flag_keys[k] = flag_arg;
 
-        if (short_k != "") {
-            if (short_k.size() > 1) {
-                panic("Parser config error: config %s's short key %s is %zu characters; A short key must be zero characters (no short key) or one character\n", flag_arg->get_name(), short_k.str().c_str(), short_k.size());
-            }
-            char c = short_k[0];
-            if (flag_short_keys.count(c) != 0 || kv_short_keys.count(c) != 0) {
-                panic("Parser config error: config %s's short key %c is a duplicate", flag_arg->get_name(), c);
-            }
-            flag_short_keys[c] = flag_arg;
+        // floor(2^1024 / 5^k) by repeated exact division; 2^1024 leaves well
+        // over 128 significant bits even at k = 348.
+        big.n = Big::max_words;
+        memset(big.w, 0, sizeof(big.w));
+        big.w[32] = 1;
+        for (int k = 1; k <= -min_exp10; k++) {
+            big.div_small(5);
+            big.top128(hi[-k - min_exp10], lo[-k - min_exp10]);
         }
+    }
+};
+
+// Eisel-Lemire: computes mant * 10^exp10 from a 64x128 bit product and
+// detects the few cases where that isn't enough to round correctly. Returns
+// false if the caller must fall back to the slow path (or on overflow and
+// subnormals, which the slow path handles).
+template<typename T>
+bool eisel_lemire(uint64_t mant, long exp10, T& val) {
+    typedef FloatTraits<T> F;
+    typedef typename F::Bits Bits;
 
+    if (exp10 < PowersOfTen::min_exp10 || exp10 > PowersOfTen::max_exp10) {
+        return false;
     }
 
+    const PowersOfTen& pow10 = PowersOfTen::get();
+    const int idx = (int)exp10 - PowersOfTen::min_exp10;
+    const int low_bits = 64 - F::mant_bits - 3;
+    const uint64_t low_mask = ((uint64_t)1 << low_bits) - 1;
 
+    int clz = 0;
+    while (!(mant & ((uint64_t)1 << (63 - clz)))) { clz++; }
+    mant <<= clz;
 
-// Parsing arguments
-//////////////////////////////////////////////////////////////////////////////
-    Result parse() {
+    uint64_t ret_exp2 = (uint64_t)(((217706 * (int64_t)exp10) >> 16) + 64 - F::bias) - (uint64_t)clz;
 
-        std::reverse(args.begin(), args.end());
+    uint64_t x_hi, x_lo;
+    mul64(mant, pow10.hi[idx], x_hi, x_lo);
 
-        while (!args.empty()) {
-            // Parse functions pop, so arg no longer valid after call
-            auto& arg = args.back();
+    // Wider approximation
+    if ((x_hi & low_mask) == low_mask && x_lo + mant < mant) {
+        uint64_t y_hi, y_lo;
+        mul64(mant, pow10.lo[idx], y_hi, y_lo);
+        uint64_t merged_hi = x_hi, merged_lo = x_lo + y_hi;
+        if (merged_lo < x_lo) { merged_hi++; }
+        if ((merged_hi & low_mask) == low_mask && merged_lo + 1 == 0 && y_lo + mant < mant) {
+            return false;
+        }
+        x_hi = merged_hi;
+        x_lo = merged_lo;
+    }
 
-            if (!saw_double_dash && arg == "--") {
-                args.pop_back();
-                saw_double_dash = true;
-                continue;
+    // Shift down to mantissa + 2 bits
+    uint64_t msb = x_hi >> 63;
+    uint64_t ret_mant = x_hi >> (msb + low_bits);
+    ret_exp2 -= 1 ^ msb;
 
-            // Long key
-            } else if (!saw_double_dash && arg.size() > 2 && arg.substr(0, 2) == "--") { 
-                auto res = parse_long_arg();
-                if (!res) {
-                    return res;
-                }
+    // Half-way ambiguity
+    if (x_lo == 0 && (x_hi & low_mask) == 0 && (ret_mant & 3) == 1) {
+        return false;
+    }
 
+    // Round to mantissa + 1 bits
+    ret_mant += ret_mant & 1;
+    ret_mant >>= 1;
+    if (ret_mant >> (F::mant_bits + 1)) {
+        ret_mant >>= 1;
+        ret_exp2++;
+    }
 
-             // Short key
-            } else if (!saw_double_dash && arg.size() > 1 && arg[0] == '-') {
-                auto res = parse_short_arg(); 
-                if (!res) {
-                    return res;
-                }
+    const uint64_t max_biased = ((uint64_t)1 << F::exp_bits) - 1;
+    if (ret_exp2 - 1 >= max_biased - 1) {
+        return false;
+    }
 
-            // Positional arg
-            } else {
-                if (pos_arg_idx < pos_args.size()) {
-                    auto res = parse_positional_arg();
-                    if (!res) {
-                        return res;
-                    }
-                } else if (vararg) {
-                    auto res = parse_vararg();
-                    if (!res) {
-                        return res;
-                    }
-                } else {
-                    // Extranous positional arg
-                    if (!silent) { 
-                        fprintf(stderr, "Too many positional arguments\n");
-                        print_usage();
-                    }
-                    return Result(Status::EXTRA_ARG, "");
-                }
-            }
-        }
+    Bits bits = (Bits)(ret_exp2 << F::mant_bits) | (Bits)(ret_mant & (((uint64_t)1 << F::mant_bits) - 1));
+    memcpy(&val, &bits, sizeof(val));
+    return true;
+}
 
-        
 
+// Decimal floats try, in order: Clinger's fast path (the significand fits in
+// the mantissa and the power of ten is exact, so one correctly rounded
+// multiply or divide does it), Eisel-Lemire, and the exact Decimal slow path
+// for the rare inputs Eisel-Lemire can't decide.
+template<typename T>
+bool parse_float(StringView str, T& val) {
+    typedef FloatTraits<T> F;
 
-        if (pos_arg_idx < pos_args.size()) {
-            if (!silent) { 
-                fprintf(stderr, "Missing required positional argument(s)\n");
-                print_usage();
-            }
-            return Result(Status::MISSING_ARG, "");
-        }
+    const char* p = str.data();
+    const char* end = p + str.size();
 
-        return Result(Status::SUCCESS, "");
+    bool neg = false;
+    if (p != end && (*p == '+' || *p == '-')) {
+        neg = *p == '-';
+        ++p;
     }
 
-    Result parse_long_arg() {
-        auto arg = args.back();
-        args.pop_back();
-
-        auto eq = arg.find('=');
-        StringView key;
-        StringView value;
+    if (p == end) {
+        return false;
+    }
 
-        // Get key;
-        if (eq != StringView::npos) {
-            key = arg.substr(2, eq - key.size() - 2);
+    if (!is_digit(*p) && *p != '.') {
+        if (matches_word(p, end, "inf") || matches_word(p, end, "infinity")) {
+            val = std::numeric_limits<T>::infinity();
+        } else if (matches_word(p, end, "nan")) {
+            val = std::numeric_limits<T>::quiet_NaN();
         } else {
-            key = arg.substr(2, StringView::npos);
+            return false;
         }
+        if (neg) { val = -val; }
+        return true;
+    }
 
-        if (key == "help") {
-            print_usage();
-            return Result(Status::HELP, "");
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        if (!parse_hex_float(p + 2, end, val)) {
+            return false;
         }
+        if (neg) { val = -val; }
+        return true;
+    }
 
-        auto it = kv_keys.find(key);
-        if (it == kv_keys.end()) {
-            auto it2 = flag_keys.find(key);
-            if (it2 == flag_keys.end()) {
-                if (!silent) { 
-                    fprintf(stderr, "Long argument key --%s invalid\n", key.str().c_str());
-                    print_usage();
-                }
-                return Result(Status::INVALID_KEY, key.str());
-            }
+    const char* int_begin = p;
+    while (p != end && is_digit(*p)) { ++p; }
+    const char* int_end = p;
+
+    const char* frac_begin = p;
+    const char* frac_end = p;
+    if (p != end && *p == '.') {
+        ++p;
+        frac_begin = p;
+        while (p != end && is_digit(*p)) { ++p; }
+        frac_end = p;
+    }
+
+    if (int_begin == int_end && frac_begin == frac_end) {
+        return false;
+    }
 
-            it2->second->parse();
-            return Result(Status::SUCCESS, "");   
+    long exp = 0;
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (!parse_exponent(p, end, exp)) {
+            return false;
         }
+    }
 
+    if (p != end) {
+        return false;
+    }
 
-        // Get value
-        if (eq != StringView::npos) {
-            value = arg.substr(eq+1, StringView::npos);
+    // Significand: the first 19 significant digits, with exp10 adjusted so
+    // that value = mant * 10^exp10 (up to the dropped digits, if trunc).
+    uint64_t mant = 0;
+    int sig_digits = 0;
+    bool trunc = false;
+    long exp10 = exp;
+    for (const char* q = int_begin; q != int_end; ++q) {
+        if (sig_digits < 19) {
+            mant = mant * 10 + (uint64_t)(*q - '0');
+            sig_digits += mant != 0;
         } else {
-            if (args.empty()) {
-                if (!silent) { 
-                    fprintf(stderr, "Long argument key --%s needs value\n", key.str().c_str());
-                    print_usage();
-                }
-                return Result(Status::MISSING_VALUE, key.str());
-            }
-
-            value = std::move(args.back());
-            args.pop_back();
+            exp10++;
+            trunc |= *q != '0';
+        }
+    }
+    for (const char* q = frac_begin; q != frac_end; ++q) {
+        if (sig_digits < 19) {
+            mant = mant * 10 + (uint64_t)(*q - '0');
+            sig_digits += mant != 0;
+            exp10--;
+        } else {
+            trunc |= *q != '0';
         }
+    }
 
-        bool good = it->second->parse(value);
-        if (!good) {
-            if (!silent) { 
-                fprintf(stderr, "Could not parse value of argument --%s\n", key.str().c_str());
-                print_usage();
-            }
-            return Result(Status::ISTREAM_ERROR, key.str());
+    if (mant == 0) {
+        val = neg ? -(T)0 : (T)0;
+        return true;
+    }
+
+    // Clinger
+    if (!trunc && FLT_EVAL_METHOD == 0
+        && mant <= ((uint64_t)1 << (F::mant_bits + 1))
+        && exp10 >= -F::max_fast_exp10 && exp10 <= F::max_fast_exp10) {
+        T v = (T)mant;
+        v = exp10 < 0 ? v / F::pow10((int)-exp10) : v * F::pow10((int)exp10);
+        val = neg ? -v : v;
+        return true;
+    }
+
+    // Eisel-Lemire. With dropped digits the true value lies between mant and
+    // mant + 1, so the result only stands if both round the same way.
+    T v;
+    if (eisel_lemire(mant, exp10, v)) {
+        T v_up;
+        if (!trunc || (eisel_lemire(mant + 1, exp10, v_up) && v == v_up)) {
+            val = neg ? -v : v;
+            return true;
         }
-        
+    }
 
-        return Result(Status::SUCCESS, "");
+    // Slow path
+    Decimal dec;
+    dec.load(int_begin, int_end, frac_begin, frac_end, exp);
+    if (!dec.to_float(val)) {
+        return false;
     }
+    if (neg) { val = -val; }
+    return true;
+}
 
+#else
 
-    Result parse_short_arg() {
-        auto arg = args.back();
-        args.pop_back();
+// Instantiated for float and double in libargs
+template<typename T>
+bool parse_float(StringView str, T& val);
 
-        char key = arg[1];
+extern template bool parse_float<float>(StringView, float&);
+extern template bool parse_float<double>(StringView, double&);
 
-        if (key == 'h') {
-            print_usage();
-            return Result(Status::HELP, "");
-        }
-        
-        auto it = kv_short_keys.find(key);
-        if (it == kv_short_keys.end()) {
-            auto it2 = flag_short_keys.find(key);
-            if (it2 == flag_short_keys.end()) {
-                if (!silent) { 
-                    fprintf(stderr, "Short argument key -%c invalid\n", key);
-                print_usage(); }
-                return Result(Status::INVALID_KEY, key);
-            } else if (arg.size() > 2) {
-                if (!silent) { 
-                    fprintf(stderr, "Flag -%c doesn't take a value\n", key);
-                    print_usage();
-                }
-                return Result(Status::EXTRA_VALUE, key);
-            }
+#endif // !defined(ARGS_DECLARE_ONLY)
 
-            it2->second->parse();
-            return Result(Status::SUCCESS, "");   
-        }
+} // namespace detail
 
 
+// float and double: locale-free, correctly rounded, with inf/nan and hex
+// floats. Overflow is an error, as it is for istream.
+template<typename T>
+struct Converter<T, typename std::enable_if<detail::is_converted_float<T>::value>::type> {
+    static bool parse(StringView str, T& val) {
+        return detail::parse_float(str, val);
+    }
+};
 
-        StringView value;
-        if (arg.size() > 2) {
-            value = arg.substr(2, StringView::npos);
-        } else {
-            if (args.empty()) {
-                if (!silent) { 
-                    fprintf(stderr, "Short argument key -%c needs value\n", key);
-                    print_usage();
-                }
-                return Result(Status::MISSING_VALUE, key);
-            }
-            value = args.back();
-            args.pop_back();
-        }
 
+////////////////////////////////////////////////////////////////////////////////
+// Key tables
+////////////////////////////////////////////////////////////////////////////////
 
-        bool good = it->second->parse(value);
-        if (!good) {
-            if (!silent) { 
-                fprintf(stderr, "Could not parse value of argument -%c\n", key);
-                print_usage();
-            }
-            return Result(Status::ISTREAM_ERROR, key);
-        }
+namespace detail {
 
-        return Result(Status::SUCCESS, ""); 
+// FNV-1a followed by a murmur3 finalizer, so that low and high bits are
+// both usable.
+ARGS_CONSTEXPR14 inline uint64_t hash_key(const char* p, size_t n, uint64_t seed=0) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (uint8_t)p[i];
+        h *= 1099511628211ull;
     }
+    h ^= seed;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
 
-    Result parse_positional_arg() {
-        auto arg = args.back();
-        args.pop_back();
+ARGS_CONSTEXPR14 inline size_t const_strlen(const char* s) {
+    size_t n = 0;
+    while (s[n]) { n++; }
+    return n;
+}
 
-        assert(pos_arg_idx < pos_args.size());
-        auto& pos_arg = pos_args.at(pos_arg_idx);
-        bool good = pos_arg->parse(arg);
-        if (!good) {
-            if (!silent) { 
-                fprintf(stderr, "Could not parse positional argument \"%s\"\n", arg.str().c_str());
-                print_usage();
-            }
-            return Result(Status::ISTREAM_ERROR, pos_arg->get_name());
+constexpr size_t next_pow2(size_t n, size_t p=1) {
+    return p >= n ? p : next_pow2(n, p * 2);
+}
+
+} // namespace detail
+
+
+// Type-erased view of a KeyTable<N>, which is what Parser holds on to.
+struct KeyTableRef {
+    const char* const* keys = nullptr;
+    const size_t* lens = nullptr;
+    const uint32_t* disp = nullptr;
+    const uint32_t* slots = nullptr;
+    size_t size = 0;
+    size_t bucket_mask = 0;
+    size_t slot_mask = 0;
+    uint64_t seed = 0;
+
+    // Index of key in the table, or -1. Always exactly one slot probe.
+    long find(StringView key) const {
+        uint64_t h = detail::hash_key(key.data(), key.size(), seed);
+        uint32_t d = disp[(h >> 40) & bucket_mask];
+        uint32_t e = slots[(h + d * ((h >> 20) | 1)) & slot_mask];
+        if (e == 0) {
+            return -1;
+        }
+
+        size_t idx = e - 1;
+        if (StringView(keys[idx], 0, lens[idx]) != key) {
+            return -1;
         }
-        pos_arg_idx++;
-        return Result(Status::SUCCESS, "");         
+        return (long)idx;
     }
+};
 
-    Result parse_vararg() {
-        auto arg = args.back();
-        args.pop_back();
 
-        bool good = vararg->parse(arg);
-        if (!good) {
-            if (!silent) { 
-                fprintf(stderr, "Could not parse vararg \"%s\"\n", arg.str().c_str());
-                print_usage();
+// Perfect hash over a fixed set of long keys (hash and displace: keys are
+// split into buckets and each bucket gets a displacement that puts all of
+// its keys in empty slots). Built with make_key_table(); under C++14 and
+// later it's built entirely at compile time when declared constexpr:
+//
+//     static constexpr auto keys = args::make_key_table("alpha", "beta");
+//     static_assert(keys.valid(), "duplicate key");
+//     parser.set_key_table(keys);
+//
+// The table must outlive any Parser using it.
+template<size_t N>
+class KeyTable {
+    static_assert(N > 0, "KeyTable needs at least one key");
+
+public:
+    static const size_t num_buckets = detail::next_pow2(N / 2 + 1);
+    static const size_t num_slots = 2 * detail::next_pow2(N);
+
+    template<typename... Keys>
+    ARGS_CONSTEXPR14 explicit KeyTable(const char* first, Keys... rest) {
+        static_assert(sizeof...(Keys) + 1 == N, "KeyTable<N> needs N keys");
+        const char* in[N] = {first, rest...};
+        for (size_t i = 0; i < N; i++) {
+            keys[i] = in[i];
+            lens[i] = detail::const_strlen(in[i]);
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (same_key(i, j)) { return; }
             }
-            return Result(Status::ISTREAM_ERROR, vararg->get_name());
         }
-        return Result(Status::SUCCESS, "");
+
+        // A full 64-bit collision would make a bucket impossible to place,
+        // so if anything fails start over with another seed.
+        for (uint64_t s = 0; s < 16 && !ok; s++) {
+            seed = s * 0x9e3779b97f4a7c15ull;
+            ok = build();
+        }
     }
 
-    void print_usage() const {
-        fprintf(stderr, "USAGE:\n");
-        fprintf(stderr, "\t%s: ", app_name);
+    // False if the keys contain duplicates.
+    constexpr bool valid() const { return ok; }
 
-        if (kv_keys.size() > 0) {
-            fprintf(stderr, " [OPTIONS] ");
-        }
+    constexpr size_t size() const { return N; }
 
-        fprintf(stderr, "[FLAGS] ");
+    const char* key(size_t i) const { return keys[i]; }
 
-        for (auto& config : pos_args) {
-            fprintf(stderr, "<%s> ", config->get_name());
-        }
+    KeyTableRef ref() const {
+        KeyTableRef r;
+        r.keys = keys;
+        r.lens = lens;
+        r.disp = disp;
+        r.slots = slots;
+        r.size = N;
+        r.bucket_mask = num_buckets - 1;
+        r.slot_mask = num_slots - 1;
+        r.seed = seed;
+        return r;
+    }
 
-        if (vararg) {
-            fprintf(stderr, "[%s]...", vararg->get_name());
-        }
+    long find(StringView key) const { return ref().find(key); }
 
+private:
+    ARGS_CONSTEXPR14 bool same_key(size_t i, size_t j) const {
+        if (lens[i] != lens[j]) { return false; }
+        for (size_t k = 0; k < lens[i]; k++) {
+            if (keys[i][k] != keys[j][k]) { return false; }
+        }
+        return true;
+    }
 
-        fprintf(stderr, "\n");
+    ARGS_CONSTEXPR14 bool build() {
+        uint64_t hashes[N] = {};
+        size_t bucket_size[num_buckets] = {};
+        size_t max_size = 0;
 
-        if (pos_args.size() > 0) {
-            fprintf(stderr, "\nARGS:\n");
-            for (auto& config : pos_args) {
-                fprintf(stderr, "\t%s\t%s\n", config->get_name(), config->get_desc());
+        for (size_t i = 0; i < N; i++) {
+            hashes[i] = detail::hash_key(keys[i], lens[i], seed);
+            size_t b = (hashes[i] >> 40) & (num_buckets - 1);
+            bucket_size[b]++;
+            if (bucket_size[b] > max_size) { max_size = bucket_size[b]; }
+        }
+        for (size_t i = 0; i < num_slots; i++) { slots[i] = 0; }
+        for (size_t b = 0; b < num_buckets; b++) { disp[b] = 0; }
+
+        // Place the biggest buckets first, while the table is emptiest
+        for (size_t size = max_size; size > 0; size--) {
+            for (size_t b = 0; b < num_buckets; b++) {
+                if (bucket_size[b] == size && !place_bucket(b, hashes)) {
+                    return false;
+                }
             }
         }
+        return true;
+    }
 
-        if (vararg) {
-            fprintf(stderr, "\t%s\t%s\n", vararg->get_name(), vararg->get_desc());
-        }
+    ARGS_CONSTEXPR14 bool place_bucket(size_t b, const uint64_t* hashes) {
+        for (uint32_t d = 0; d < (1u << 16); d++) {
+            size_t placed = 0;
+            bool fits = true;
 
-        if (kv_keys.size() > 0) {
-            fprintf(stderr, "\nOPTIONS:\n");
-            for (auto& p : kv_keys) {
-                fprintf(stderr, "\t--%s", p.first.str().c_str());
+            for (size_t i = 0; i < N && fits; i++) {
+                uint64_t h = hashes[i];
+                if (((h >> 40) & (num_buckets - 1)) != b) { continue; }
 
-                if (*p.second->get_short_key() != '\0') {
-                    fprintf(stderr, ", -%s", p.second->get_short_key());
+                size_t slot = (h + d * ((h >> 20) | 1)) & (num_slots - 1);
+                if (slots[slot] != 0) {
+                    fits = false;
+                } else {
+                    slots[slot] = (uint32_t)(i + 1);
+                    placed++;
                 }
+            }
+
+            if (fits) {
+                disp[b] = d;
+                return true;
+            }
 
-                fprintf(stderr, " <val>\t%s\n", p.second->get_desc());
+            // Undo this attempt
+            for (size_t i = 0; i < N && placed > 0; i++) {
+                uint64_t h = hashes[i];
+                if (((h >> 40) & (num_buckets - 1)) != b) { continue; }
+                size_t slot = (h + d * ((h >> 20) | 1)) & (num_slots - 1);
+                if (slots[slot] == i + 1) {
+                    slots[slot] = 0;
+                    placed--;
+                }
             }
         }
+        return false;
+    }
+
+    const char* keys[N] = {};
+    size_t lens[N] = {};
+    uint32_t disp[num_buckets] = {};
+    uint32_t slots[num_slots] = {};
+    uint64_t seed = 0;
+    bool ok = false;
+};
 
+template<typename... Keys>
+ARGS_CONSTEXPR14 KeyTable<sizeof...(Keys)> make_key_table(Keys... keys) {
+    return KeyTable<sizeof...(Keys)>(keys...);
+}
 
-        fprintf(stderr, "\nFLAGS:\n");
-        for (auto& p : flag_keys) {
-            fprintf(stderr, "\t--%s", p.first.str().c_str());
 
-            if (*p.second->get_short_key() != '\0') {
-                fprintf(stderr, ", -%s", p.second->get_short_key());
-            }
+////////////////////////////////////////////////////////////////////////////////
+// Thread pool
+////////////////////////////////////////////////////////////////////////////////
+class ThreadPool;
+
+#if !defined(ARGS_NO_THREADS)
 
-            fprintf(stderr, "\t%s\n", p.second->get_desc());
+// A fixed set of threads for parallel_for. Define ARGS_NO_THREADS to leave
+// this out, along with Schema::parse_batch and parallel vararg conversion.
+class ThreadPool {
+public:
+    // 0 means one thread per hardware thread. The thread calling
+    // parallel_for is one of them.
+    explicit ThreadPool(unsigned n_threads=0)
+    : n(n_threads ? n_threads : std::max(1u, std::thread::hardware_concurrency())),
+      ranges(new Range[n]) {
+        for (unsigned w = 1; w < n; w++) {
+            threads.emplace_back([this, w] { worker_loop(w); });
         }
-        fprintf(stderr, "\t--help, -h\tPrint help message\n");
     }
 
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
 
-private:
-    const char* app_name;
-    std::vector<StringView> args;
-    bool silent = false;
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
 
-    uint32_t pos_arg_idx = 0;
-    std::vector<PosArgBase*> pos_args;
+    unsigned size() const { return n; }
 
-    std::map<StringView, KVArgBase*> kv_keys;
-    std::map<char, KVArgBase*> kv_short_keys;
+    // Calls f(worker, begin, end) on disjoint chunks of at most grain indices
+    // covering [0, count), on every thread at once, and returns when they're
+    // all done. Each worker starts on an even slice; once that's used up it
+    // steals the back half of another worker's remainder. worker is in
+    // [0, size()), and the caller is worker 0. One call at a time.
+    template<typename F>
+    void parallel_for(size_t count, size_t grain, F&& f) {
+        typedef typename std::remove_reference<F>::type Fn;
+        assert(count <= UINT32_MAX);
 
-    std::map<StringView, FlagArg*> flag_keys;
-    std::map<char, FlagArg*> flag_short_keys;
+        for (unsigned w = 0; w < n; w++) {
+            ranges[w].bits.store(pack(count * w / n, count * (w + 1) / n), std::memory_order_relaxed);
+        }
 
-    VarArgBase* vararg = nullptr;
+        Job job;
+        job.fn = [](void* ctx, unsigned w, size_t begin, size_t end) { (*(Fn*)ctx)(w, begin, end); };
+        job.ctx = (void*)&f;
+        job.grain = std::max<size_t>(grain, 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &job;
+            busy = n - 1;
+            generation++;
+        }
+        wake.notify_all();
 
-    bool saw_double_dash = false;
-};
+        run(0, job);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+        current = nullptr;
+    }
+
+private:
+    struct Job {
+        void (*fn)(void*, unsigned, size_t, size_t);
+        void* ctx;
+        size_t grain;
+    };
+
+    // A worker's unclaimed [begin, end) packed in one word, so the owner
+    // (claiming from the front) and thieves (taking the back half) each
+    // claim with a single CAS. Padded to keep workers off each other's
+    // cache lines.
+    struct Range {
+        std::atomic<uint64_t> bits;
+        char pad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static uint64_t pack(size_t begin, size_t end) { return (uint64_t)begin | ((uint64_t)end << 32); }
+    static size_t range_begin(uint64_t bits) { return (uint32_t)bits; }
+    static size_t range_end(uint64_t bits) { return (size_t)(bits >> 32); }
+
+    void worker_loop(unsigned w) {
+        uint64_t seen = 0;
+        for (;;) {
+            Job* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return generation != seen; });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+                job = current;
+            }
+
+            run(w, *job);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    void run(unsigned w, const Job& job) {
+        size_t begin, end;
+        do {
+            while (claim(w, job.grain, begin, end)) {
+                job.fn(job.ctx, w, begin, end);
+            }
+        } while (steal(w));
+    }
+
+    bool claim(unsigned w, size_t grain, size_t& begin, size_t& end) {
+        auto& bits = ranges[w].bits;
+        uint64_t cur = bits.load(std::memory_order_acquire);
+        for (;;) {
+            size_t b = range_begin(cur), e = range_end(cur);
+            if (b >= e) {
+                return false;
+            }
+            size_t next = std::min(b + grain, e);
+            if (bits.compare_exchange_weak(cur, pack(next, e), std::memory_order_acq_rel)) {
+                begin = b;
+                end = next;
+                return true;
+            }
+        }
+    }
+
+    // Only called with w's own range empty, so no one else writes it
+    bool steal(unsigned w) {
+        for (unsigned i = 1; i < n; i++) {
+            auto& bits = ranges[(w + i) % n].bits;
+            uint64_t cur = bits.load(std::memory_order_acquire);
+            for (;;) {
+                size_t b = range_begin(cur), e = range_end(cur);
+                if (b >= e) {
+                    break;
+                }
+                size_t mid = b + (e - b) / 2;
+                if (bits.compare_exchange_weak(cur, pack(b, mid), std::memory_order_acq_rel)) {
+                    ranges[w].bits.store(pack(mid, e), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    unsigned n;
+    std::unique_ptr<Range[]> ranges;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    Job* current = nullptr;
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+};
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Parse results
+////////////////////////////////////////////////////////////////////////////////
+
+
+enum class Status {
+    SUCCESS = 0,
+    INVALID_KEY,
+    MISSING_VALUE,
+    EXTRA_VALUE,
+    ISTREAM_ERROR,
+    IS_FLAG,
+    MISSING_ARG,
+    EXTRA_ARG,
+    HELP,
+    RESPONSE_FILE_ERROR,
+    CONFIG_FILE_ERROR,
+    AMBIGUOUS_KEY,
+    COMPLETED,
+    INVALID_COMMAND,
+    CONFIG_ERROR,
+    SOURCE_ERROR
+};
+
+static const size_t status_count = (size_t)Status::SOURCE_ERROR + 1;
+
+namespace detail {
+
+// A class template's static member may be defined in a header: every file
+// including it shares the one array, where a plain array would be defined
+// once per file and fail to link.
+template<typename Dummy=void>
+struct StatusNames {
+    static const char* const names[status_count];
+};
+
+template<typename Dummy>
+const char* const StatusNames<Dummy>::names[status_count] = {
+    "SUCCESS",
+    "INVALID_KEY",
+    "MISSING_VALUE",
+    "EXTRA_VALUE",
+    "ISTREAM_ERROR",
+    "IS_FLAG",
+    "MISSING_ARG",
+    "EXTRA_ARG",
+    "HELP",
+    "RESPONSE_FILE_ERROR",
+    "CONFIG_FILE_ERROR",
+    "AMBIGUOUS_KEY",
+    "COMPLETED",
+    "INVALID_COMMAND",
+    "CONFIG_ERROR",
+    "SOURCE_ERROR"
+};
+
+} // namespace detail
+
+// Status names, indexed by Status
+static const char* const (&status_str)[status_count] = detail::StatusNames<>::names;
+
+static inline std::ostream& operator<<(std::ostream& os, Status s) {
+    os << status_str[(int)s];
+    return os;
+}
+
+// item borrows from argv or the argument's name, so making a Result never
+// allocates.
+struct Result {
+    Status status;
+    StringView item;
+
+    // For errors in a config file, the line they're on; otherwise 0
+    uint32_t line = 0;
+
+    // For an INVALID_KEY long key, the nearest registered keys, closest
+    // first (see Schema::suggest). Borrowed from the ParseState, so valid
+    // until its next parse.
+    static constexpr size_t max_suggestions = 3;
+    const StringView* suggestions = nullptr;
+    uint32_t suggestion_count = 0;
+
+    explicit Result(Status _status, StringView _item) : status(_status), item(_item) {}
+
+    operator bool() { return status == Status::SUCCESS; }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Forward declarations
+////////////////////////////////////////////////////////////////////////////////
+class KVArgBase;
+class PosArgBase;
+class FlagArg;
+class VarArgBase;
+class SubcommandBase;
+class Schema;
+class ArgBase;
+
+namespace detail {
+// An argument's parse() without the virtual call, so the parser can convert
+// through a plain function pointer it keeps beside the argument's pointer
+typedef bool (*ConvertFn)(ArgBase* arg, StringView str);
+}
+
+// What an argument's values convert to, as ParseStats counts conversions.
+// LAZY values (LazyKVArg) are only recorded while parsing.
+enum class ValueType {
+    INTEGER,
+    FLOAT,
+    STRING,
+    VIEW,
+    LAZY,
+    OTHER
+};
+
+static const size_t value_type_count = (size_t)ValueType::OTHER + 1;
+
+namespace detail {
+
+template<typename T>
+struct value_type_of : std::integral_constant<ValueType,
+    is_converted_integer<T>::value ? ValueType::INTEGER :
+    is_converted_float<T>::value ? ValueType::FLOAT :
+    std::is_same<T, std::string>::value ? ValueType::STRING :
+    std::is_same<T, StringView>::value ? ValueType::VIEW :
+#if __cplusplus >= 201703L
+    std::is_same<T, std::string_view>::value ? ValueType::VIEW :
+#endif
+    ValueType::OTHER> {};
+
+} // namespace detail
+
+class ParserBase {
+public:
+    virtual ~ParserBase() {}
+    virtual void add_pos_arg(PosArgBase *pos_arg) = 0;
+    virtual void add_kv_arg(KVArgBase *kv_arg) = 0;
+    virtual void add_flag_arg(FlagArg *flag_arg) = 0;
+    virtual void add_vararg(VarArgBase* vararg) = 0;
+    virtual void add_subcommand(SubcommandBase* subcommand) = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Argument classes
+////////////////////////////////////////////////////////////////////////////////
+class ArgBase {
+public:
+    ArgBase(const char* _name, const char *_desc, detail::ConvertFn _convert=nullptr) 
+    : name(_name), desc(_desc), convert(_convert) {}
+
+    virtual ~ArgBase() {}
+
+    const char *get_desc() const { return desc; }
+    const char *get_name() const { return name; }
+
+    // Position in the schema's registration order
+    uint32_t get_id() const { return id; }
+
+    // Environment variable read when the argument isn't given, or null
+    const char* get_env() const { return env; }
+
+    bool found() const { return was_found; }
+    operator bool() const { return found(); }
+
+    // Forgets the last parse's value, before the next one
+    virtual void reset() { was_found = false; }
+
+    // False if a value was given but doesn't convert. Only arguments that
+    // convert lazily can get this far with a bad value.
+    virtual bool validate() const { return true; }
+
+    // Takes the value of the argument's environment variable
+    virtual bool parse_env(StringView) { return true; }
+
+    virtual ValueType value_type() const { return ValueType::OTHER; }
+
+protected:
+    friend class Schema;
+
+    bool was_found = false;
+    uint32_t id = 0;
+    const char* env = nullptr;
+    const char *name;
+    const char *desc;
+    // What parse() does, for argument types that have it as a plain
+    // function; otherwise the parser calls parse()
+    detail::ConvertFn convert;
+};
+
+
+
+class PosArgBase : public ArgBase {
+public:
+    PosArgBase(ParserBase& parser, const char* _name, const char *_desc, detail::ConvertFn _convert=nullptr) 
+    : ArgBase(_name, _desc, _convert) {
+        parser.add_pos_arg(this);
+    }
+
+    virtual bool parse(StringView str) = 0;
+
+    // Whether str converts, without storing it
+    virtual bool check(StringView str) const = 0;
+};
+
+template<typename T>
+class PosArg : public PosArgBase {
+public:
+    PosArg(ParserBase& parser, const char* _name, const char *_desc) 
+    : PosArgBase(parser, _name, _desc, &PosArg::apply) {}
+
+
+    bool parse(StringView str) override {
+        return apply(this, str);
+    }
+
+    bool check(StringView str) const override {
+        T tmp{};
+        return Converter<T>::parse(str, tmp);
+    }
+
+    ValueType value_type() const override { return detail::value_type_of<T>::value; }
+
+
+    const T& value() const {
+        assert(was_found);
+        return val;
+    }
+
+    const T& operator*() const {
+        return value();
+    }
+
+private:
+    static bool apply(ArgBase* self, StringView str) {
+        PosArg* arg = static_cast<PosArg*>(self);
+        arg->was_found = true;
+        return Converter<T>::parse(str, arg->val);
+    }
+
+    T val{};
+};
+
+
+class VarArgBase : public ArgBase {
+public:
+    VarArgBase(ParserBase& parser, const char* _name, const char *_desc) 
+    : ArgBase(_name, _desc) {
+        parser.add_vararg(this);
+    }
+
+    virtual bool parse(StringView str) = 0;
+    virtual bool check(StringView str) const = 0;
+
+    // Converts n tokens at once into exactly reserved storage, in chunks on
+    // pool's threads if pool isn't null and n is large. On failure bad is the
+    // first token that didn't convert, and only the values before it are
+    // kept, as if they'd been parsed one at a time.
+    virtual bool parse_all(const StringView* toks, size_t n, ThreadPool* pool, size_t& bad) = 0;
+};
+
+
+template<typename T>
+class VarArg : public VarArgBase {
+    // To prevent confusion with operator bool
+    static_assert(!std::is_same<T, bool>::value, "Use FlagArg for bool");
+
+public:
+    VarArg(ParserBase& parser, const char* _name, const char *_desc) 
+    : VarArgBase(parser, _name, _desc) {}
+
+    bool parse(StringView str) override {
+        was_found = true;
+
+        T val{};
+        if (!Converter<T>::parse(str, val)) {
+            return false;
+        }
+
+        vals.push_back(val);
+        return true;
+    }
+
+    bool check(StringView str) const override {
+        T tmp{};
+        return Converter<T>::parse(str, tmp);
+    }
+
+    ValueType value_type() const override { return detail::value_type_of<T>::value; }
+
+    bool parse_all(const StringView* toks, size_t n, ThreadPool* pool, size_t& bad) override {
+        was_found = was_found || n > 0;
+
+        // Exactly n for the first run; geometric after that, so a vararg
+        // interleaved with keys doesn't reallocate for every run
+        size_t base = vals.size();
+        if (vals.capacity() < base + n) {
+            vals.reserve(std::max(base + n, 2 * vals.capacity()));
+        }
+        vals.resize(base + n);
+        T* out = vals.data() + base;
+
+#if !defined(ARGS_NO_THREADS)
+        if (pool && pool->size() > 1 && n >= 16384) {
+            std::atomic<size_t> first_bad(n);
+            size_t grain = std::max<size_t>(n / (pool->size() * 8), 1024);
+
+            pool->parallel_for(n, grain, [&](unsigned, size_t begin, size_t end) {
+                // Past the first failure, values are thrown away anyway
+                for (size_t i = begin; i < end && i < first_bad.load(std::memory_order_relaxed); i++) {
+                    if (!Converter<T>::parse(toks[i], out[i])) {
+                        size_t cur = first_bad.load();
+                        while (i < cur && !first_bad.compare_exchange_weak(cur, i)) {}
+                        return;
+                    }
+                }
+            });
+            bad = first_bad.load();
+        } else
+#endif
+        {
+            (void)pool;
+            bad = n;
+            for (size_t i = 0; i < n; i++) {
+                if (!Converter<T>::parse(toks[i], out[i])) {
+                    bad = i;
+                    break;
+                }
+            }
+        }
+
+        if (bad < n) {
+            vals.resize(base + bad);
+            return false;
+        }
+        return true;
+    }
+
+    void reset() override {
+        VarArgBase::reset();
+        vals.clear();
+    }
+
+    const std::vector<T>& value() const {
+        return vals;
+    }
+
+    const std::vector<T>& operator*() const {
+        return value();
+    }
+
+private:
+    std::vector<T> vals;
+};
+
+
+class KVArgBase : public ArgBase {
+public:
+    KVArgBase(ParserBase& parser, const char* _k, const char* _short_k, const char* _desc, detail::ConvertFn _convert=nullptr) 
+    : ArgBase(_k, _desc, _convert), k(_k), short_k(_short_k) {
+        parser.add_kv_arg(this);
+    }
+
+    virtual bool parse(StringView str) = 0;
+    virtual bool check(StringView str) const = 0;
+
+    // Like parse(), for text that won't outlive the call
+    virtual bool parse_now(StringView str) { return parse(str); }
+
+    // Falls back to the environment variable name when the key isn't given
+    // (see Schema::parse). The value goes through the same conversion.
+    void set_env(const char* name) { env = name; }
+
+    bool parse_env(StringView str) override { return parse_now(str); }
+
+    const char* get_key() const { return k; }
+    const char* get_short_key() const { return short_k; }
+
+protected:
+    const char* k;
+    const char* short_k;   
+};
+
+
+template<typename T>
+class KVArg : public KVArgBase {
+    // To prevent confusion with operator bool
+    static_assert(!std::is_same<T, bool>::value, "Use FlagArg for bool");
+public:
+    KVArg(ParserBase& parser, const char* _k, const char* _short_k, const char* _desc)
+    : KVArgBase(parser, _k, _short_k, _desc, &KVArg::apply) {}
+
+    bool parse(StringView str) override {
+        return apply(this, str);
+    }
+
+    bool check(StringView str) const override {
+        T tmp{};
+        return Converter<T>::parse(str, tmp);
+    }
+
+    ValueType value_type() const override { return detail::value_type_of<T>::value; }
+
+
+    const T& value() const {
+        assert(was_found);
+        return val;
+    }
+
+    T value_or(T def) const {
+        return was_found ? val : def;
+    }
+
+    const T& operator*() const {
+        return value();
+    }
+
+private:
+    static bool apply(ArgBase* self, StringView str) {
+        KVArg* arg = static_cast<KVArg*>(self);
+        arg->was_found = true;
+        return Converter<T>::parse(str, arg->val);
+    }
+
+    T val{};
+};
+
+
+// A KVArg that only records its text while parsing. The first value() (or
+// get()) converts it and caches the result, so options a program never reads
+// never pay for conversion. A bad value isn't a parse() error: find it with
+// Schema::validate_all(), or with get() or status() when the value is read.
+// The text must outlive the argument, as for KVArg<StringView>; with sources
+// whose tokens don't (FdSource), values are copied and converted while
+// parsing instead.
+// Reading the value isn't thread-safe.
+template<typename T>
+class LazyKVArg : public KVArgBase {
+    // To prevent confusion with operator bool
+    static_assert(!std::is_same<T, bool>::value, "Use FlagArg for bool");
+public:
+    LazyKVArg(ParserBase& parser, const char* _k, const char* _short_k, const char* _desc)
+    : KVArgBase(parser, _k, _short_k, _desc, &LazyKVArg::apply) {}
+
+    bool parse(StringView str) override {
+        return apply(this, str);
+    }
+
+    // The text is copied, so raw() stays good after the source reuses it
+    bool parse_now(StringView str) override {
+        owned.assign(str.data(), str.size());
+        parse(owned);
+        convert();
+        return true;
+    }
+
+    bool check(StringView str) const override {
+        T tmp{};
+        return Converter<T>::parse(str, tmp);
+    }
+
+    ValueType value_type() const override { return ValueType::LAZY; }
+
+    void reset() override {
+        KVArgBase::reset();
+        state = PENDING;
+    }
+
+    bool validate() const override {
+        return !was_found || status() == Status::SUCCESS;
+    }
+
+    // ISTREAM_ERROR if the value doesn't convert. Converts it if needed.
+    Status status() const {
+        convert();
+        return state == BAD ? Status::ISTREAM_ERROR : Status::SUCCESS;
+    }
+
+    // The value as given, unconverted
+    StringView raw() const {
+        assert(was_found);
+        return text;
+    }
+
+    // False, leaving out alone, if the value doesn't convert
+    bool get(T& out) const {
+        assert(was_found);
+        if (status() != Status::SUCCESS) {
+            return false;
+        }
+        out = val;
+        return true;
+    }
+
+    // A value that doesn't convert reads as T{}; check status() or use get()
+    const T& value() const {
+        assert(was_found);
+        convert();
+        return val;
+    }
+
+    T value_or(T def) const {
+        return was_found && status() == Status::SUCCESS ? val : def;
+    }
+
+    const T& operator*() const {
+        return value();
+    }
+
+private:
+    enum State { PENDING, GOOD, BAD };
+
+    static bool apply(ArgBase* self, StringView str) {
+        LazyKVArg* arg = static_cast<LazyKVArg*>(self);
+        arg->was_found = true;
+        arg->text = str;
+        arg->state = PENDING;
+        return true;
+    }
+
+    void convert() const {
+        if (state == PENDING && was_found) {
+            val = T{};
+            state = Converter<T>::parse(text, val) ? GOOD : BAD;
+            if (state == BAD) {
+                val = T{};
+            }
+        }
+    }
+
+    StringView text;
+    // The text, for values that wouldn't otherwise outlive the parse
+    std::string owned;
+    mutable State state = PENDING;
+    mutable T val{};
+};
+
+
+
+class FlagArg : public ArgBase {
+public:
+    FlagArg(ParserBase& parser, const char* _k, const char* _short_k, const char *_desc) 
+    : ArgBase(_k, _desc), k(_k), short_k(_short_k) {
+        parser.add_flag_arg(this);
+    }
+
+    void parse() {
+        was_found = true;
+    }
+
+    // Falls back to the environment variable name when the flag isn't given
+    // (see Schema::parse). 1, true, yes and on set the flag; 0, false, no,
+    // off and the empty string leave it unset; anything else is an error.
+    void set_env(const char* name) { env = name; }
+
+    bool parse_env(StringView str) override {
+        static const char* const on[] = {"1", "true", "yes", "on"};
+        static const char* const off[] = {"", "0", "false", "no", "off"};
+        for (const char* word : on) {
+            if (detail::equal_ignore_case(str, word)) {
+                was_found = true;
+                return true;
+            }
+        }
+        for (const char* word : off) {
+            if (detail::equal_ignore_case(str, word)) {
+                was_found = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool value() const {
+        return was_found;
+    }
+
+    bool operator*() const {
+        return value();
+    }
+
+    const char* get_key() const { return k; }
+    const char* get_short_key() const { return short_k; }
+
+protected:
+    const char* k;
+    const char* short_k;
+};
+
+
+// A subcommand, selected by name as the first positional token (see
+// Subcommand). Found if it was selected.
+class SubcommandBase : public ArgBase {
+public:
+    SubcommandBase(ParserBase& parser, const char* _name, const char *_desc) 
+    : ArgBase(_name, _desc) {
+        parser.add_subcommand(this);
+    }
+
+protected:
+    friend class Schema;
+
+    // Marks the subcommand selected, and returns its schema, building it
+    // (configured like parent) if this is the first time
+    virtual const Schema& select(const Schema& parent) = 0;
+
+    // The schema, once built
+    const Schema* built = nullptr;
+};
+
+
+// Value types libargs instantiates the argument classes for. With
+// ARGS_SEPARATE_COMPILATION, files including the header use those
+// instantiations instead of making their own.
+#define ARGS_COMMON_TYPES(X) \
+    X(int) X(unsigned) X(long) X(unsigned long) X(long long) X(unsigned long long) \
+    X(float) X(double) X(std::string) X(StringView)
+
+#if defined(ARGS_DECLARE_ONLY)
+#define ARGS_EXTERN_ARGS(T) \
+    extern template class PosArg<T>; \
+    extern template class VarArg<T>; \
+    extern template class KVArg<T>; \
+    extern template class LazyKVArg<T>;
+ARGS_COMMON_TYPES(ARGS_EXTERN_ARGS)
+#undef ARGS_EXTERN_ARGS
+#endif
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Memory resources
+////////////////////////////////////////////////////////////////////////////////
+
+// Where a Parser keeps its internal state. This is the shape of C++17's
+// std::pmr::memory_resource, so wrapping one of those is a few lines.
+class MemoryResource {
+public:
+    virtual ~MemoryResource() {}
+    virtual void* allocate(size_t bytes, size_t align) = 0;
+    virtual void deallocate(void* p, size_t bytes, size_t align) = 0;
+};
+
+inline MemoryResource* new_delete_resource() {
+    struct NewDelete : MemoryResource {
+        void* allocate(size_t bytes, size_t) override { return ::operator new(bytes); }
+        void deallocate(void* p, size_t, size_t) override { ::operator delete(p); }
+    };
+    static NewDelete resource;
+    return &resource;
+}
+
+
+// Bump allocator over a caller-supplied buffer. Deallocation is a no-op;
+// everything is released at once when the Arena goes away. If the buffer
+// runs out, further blocks come from upstream (the heap by default), or
+// std::bad_alloc is thrown if upstream is null.
+class Arena : public MemoryResource {
+public:
+    Arena(void* buf, size_t size, MemoryResource* _upstream=new_delete_resource())
+    : cur((char*)buf), end((char*)buf + size), upstream(_upstream) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        while (overflow) {
+            Overflow* next = overflow->next;
+            upstream->deallocate(overflow, overflow->size, alignof(Overflow));
+            overflow = next;
+        }
+    }
+
+    void* allocate(size_t bytes, size_t align) override {
+        char* p = align_up(cur, align);
+        if (p <= end && bytes <= (size_t)(end - p)) {
+            cur = p + bytes;
+            return p;
+        }
+
+        if (!upstream) {
+            throw std::bad_alloc();
+        }
+
+        size_t size = sizeof(Overflow) + bytes + align;
+        auto* block = (Overflow*)upstream->allocate(size, alignof(Overflow));
+        block->next = overflow;
+        block->size = size;
+        overflow = block;
+        return align_up((char*)(block + 1), align);
+    }
+
+    void deallocate(void*, size_t, size_t) override {}
+
+    // Bytes of the caller's buffer still free
+    size_t remaining() const { return (size_t)(end - cur); }
+
+private:
+    struct Overflow {
+        Overflow* next;
+        size_t size;
+    };
+
+    static char* align_up(char* p, size_t align) {
+        return (char*)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    char* cur;
+    char* end;
+    MemoryResource* upstream;
+    Overflow* overflow = nullptr;
+};
+
+
+// Passes everything on to upstream, counting the allocations and bytes.
+class CountingResource : public MemoryResource {
+public:
+    explicit CountingResource(MemoryResource* _upstream=new_delete_resource()) : upstream(_upstream) {}
+
+    void* allocate(size_t bytes, size_t align) override {
+        allocs++;
+        allocated += bytes;
+        return upstream->allocate(bytes, align);
+    }
+
+    void deallocate(void* p, size_t bytes, size_t align) override {
+        upstream->deallocate(p, bytes, align);
+    }
+
+    uint64_t allocations() const { return allocs; }
+    uint64_t bytes() const { return allocated; }
+
+    MemoryResource* get_upstream() const { return upstream; }
+
+private:
+    MemoryResource* upstream;
+    uint64_t allocs = 0;
+    uint64_t allocated = 0;
+};
+
+
+// Standard allocator over a MemoryResource, for the Parser's containers.
+template<typename T>
+class Allocator {
+public:
+    typedef T value_type;
+    // Move assignment takes the source's storage and resource, which is how
+    // a container is moved to another resource (see ParseState::set_stats)
+    typedef std::true_type propagate_on_container_move_assignment;
+
+    Allocator(MemoryResource* _resource=new_delete_resource()) : resource(_resource) {}
+
+    template<typename U>
+    Allocator(const Allocator<U>& other) : resource(other.get_resource()) {}
+
+    T* allocate(size_t n) {
+        return (T*)resource->allocate(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T* p, size_t n) {
+        resource->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    MemoryResource* get_resource() const { return resource; }
+
+    template<typename U>
+    bool operator==(const Allocator<U>& rhs) const { return resource == rhs.get_resource(); }
+
+    template<typename U>
+    bool operator!=(const Allocator<U>& rhs) const { return resource != rhs.get_resource(); }
+
+private:
+    MemoryResource* resource;
+};
+
+template<typename T>
+using Vector = std::vector<T, Allocator<T>>;
+
+template<typename K, typename V>
+using Map = std::map<K, V, std::less<K>, Allocator<std::pair<const K, V>>>;
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Token sources
+////////////////////////////////////////////////////////////////////////////////
+
+// Where the Parser gets its tokens, one at a time. A token only needs to stay
+// valid until the following call to next(): the parser looks ahead by one
+// token (a key's value) and is done with the key by then. Arguments that
+// keep views (such as KVArg<StringView>) need the source's memory to outlive
+// them, which holds for argv and BufferSource but not for FdSource.
+class TokenSource {
+public:
+    virtual ~TokenSource() {}
+
+    // False once the source is exhausted
+    virtual bool next(StringView& tok) = 0;
+
+    // Whether tokens stay valid for as long as the source does
+    virtual bool stable() const { return false; }
+
+    // Whether the source stopped on an error rather than at its end, so the
+    // tokens it gave aren't all there were. parse() is a SOURCE_ERROR then.
+    virtual bool failed() const { return false; }
+};
+
+
+class ArgvSource : public TokenSource {
+public:
+    ArgvSource() = default;
+
+    // Skips argv[0], like Parser always has
+    ArgvSource(int argc, const char** argv)
+    : cur(argc > 0 ? argv + 1 : argv), end(argc > 0 ? argv + argc : argv) {}
+
+    bool next(StringView& tok) override {
+        if (cur == end) {
+            return false;
+        }
+        tok = *cur++;
+        return true;
+    }
+
+    bool stable() const override { return true; }
+
+private:
+    const char** cur = nullptr;
+    const char** end = nullptr;
+};
+
+
+namespace detail {
+
+inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline StringView trim(StringView s) {
+    const char* b = s.data();
+    const char* e = b + s.size();
+    while (b != e && is_space(*b)) { ++b; }
+    while (e != b && is_space(e[-1])) { --e; }
+    return StringView::from_range(b, e);
+}
+
+// Writes all of [p, p + n) to f, with a single write(2) when it can
+inline void write_all(FILE* f, const char* p, size_t n) {
+    fflush(f);
+#if defined(ARGS_POSIX)
+    int fd = fileno(f);
+    while (n > 0) {
+        ssize_t written = write(fd, p, n);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            return;
+        }
+        p += written;
+        n -= (size_t)written;
+    }
+#else
+    fwrite(p, 1, n, f);
+    fflush(f);
+#endif
+}
+
+#if defined(ARGS_POSIX)
+// Maps the file at path privately, for reading front to back. An empty file
+// leaves base null. Returns why it couldn't, or null.
+inline const char* map_file(StringView path, int prot, char*& base, size_t& size, struct stat& st) {
+    char path_buf[4096];
+    base = nullptr;
+    size = 0;
+
+    if (path.size() >= sizeof(path_buf)) {
+        return "path too long";
+    }
+    memcpy(path_buf, path.data(), path.size());
+    path_buf[path.size()] = '\0';
+
+    int fd = open(path_buf, O_RDONLY);
+    if (fd < 0) {
+        return strerror(errno);
+    }
+
+    const char* err = nullptr;
+    if (fstat(fd, &st) != 0) {
+        err = strerror(errno);
+    } else if (st.st_size > 0) {
+        void* p = mmap(nullptr, (size_t)st.st_size, prot, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            err = strerror(errno);
+        } else {
+            base = (char*)p;
+            size = (size_t)st.st_size;
+            madvise(p, size, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+    return err;
+}
+#endif
+
+} // namespace detail
+
+
+// Whitespace-separated tokens in a caller-owned buffer
+class BufferSource : public TokenSource {
+public:
+    explicit BufferSource(StringView buf) : cur(buf.data()), end(buf.data() + buf.size()) {}
+
+    bool next(StringView& tok) override {
+        while (cur != end && detail::is_space(*cur)) { ++cur; }
+        if (cur == end) {
+            return false;
+        }
+
+        const char* start = cur;
+        while (cur != end && !detail::is_space(*cur)) { ++cur; }
+        tok = StringView::from_range(start, cur);
+        return true;
+    }
+
+    bool stable() const override { return true; }
+
+private:
+    const char* cur;
+    const char* end;
+};
+
+
+namespace detail {
+
+// Next token of a response file. Tokens are whitespace separated; '...'
+// quotes literally, "..." quotes with \" and \\ escapes, and outside quotes
+// a backslash escapes any character. Quotes and escapes are removed in
+// place, so a token is always a view of (a prefix of) its own bytes, and
+// bytes are only written for tokens that had something to remove. A quote
+// still open at end is malformed: returns false with unterminated set.
+inline bool next_quoted_token(char*& cur, char* end, StringView& tok, bool& unterminated) {
+    unterminated = false;
+    while (cur != end && is_space(*cur)) { ++cur; }
+    if (cur == end) {
+        return false;
+    }
+
+    char* start = cur;
+    char* w = cur;
+    char quote = 0;
+
+    while (cur != end) {
+        char c = *cur;
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+                ++cur;
+                continue;
+            }
+            if (c == '\\' && quote == '"' && cur + 1 != end && (cur[1] == '"' || cur[1] == '\\')) {
+                c = *++cur;
+            }
+        } else {
+            if (is_space(c)) {
+                break;
+            }
+            if (c == '"' || c == '\'') {
+                quote = c;
+                ++cur;
+                continue;
+            }
+            if (c == '\\' && cur + 1 != end) {
+                c = *++cur;
+            }
+        }
+
+        if (w != cur) { *w = c; }
+        ++w;
+        ++cur;
+    }
+
+    if (quote) {
+        unterminated = true;
+        return false;
+    }
+    tok = StringView::from_range(start, w);
+    return true;
+}
+
+} // namespace detail
+
+
+#if defined(ARGS_POSIX)
+
+// Whitespace-separated tokens read from a file descriptor (a pipe, socket or
+// file) through a fixed-size buffer, so a stream of any length is parsed in
+// constant memory. Tokens longer than the buffer stop the stream and set
+// failed(), as do read errors.
+class FdSource : public TokenSource {
+public:
+    explicit FdSource(int _fd, size_t _capacity=64 * 1024, MemoryResource& _resource=*new_delete_resource())
+    : fd(_fd), capacity(_capacity), resource(&_resource) {
+        buf = (char*)resource->allocate(capacity, 1);
+    }
+
+    FdSource(const FdSource&) = delete;
+    FdSource& operator=(const FdSource&) = delete;
+
+    ~FdSource() {
+        resource->deallocate(buf, capacity, 1);
+    }
+
+    bool next(StringView& tok) override {
+        for (;;) {
+            while (pos < len && detail::is_space(buf[pos])) { pos++; }
+            if (pos < len) {
+                break;
+            }
+            if (!fill(pos)) {
+                return false;
+            }
+        }
+
+        size_t start = pos;
+        for (;;) {
+            while (pos < len && !detail::is_space(buf[pos])) { pos++; }
+            if (pos < len) {
+                break;
+            }
+            if (!fill(start)) {
+                if (has_failed) {
+                    return false;
+                }
+                break;
+            }
+        }
+
+        tok = StringView::from_range(buf + start, buf + pos);
+        return true;
+    }
+
+    bool failed() const override { return has_failed; }
+
+private:
+    // Moves the token in progress (from start) to the front and reads more.
+    bool fill(size_t& start) {
+        if (start > 0) {
+            memmove(buf, buf + start, len - start);
+            len -= start;
+            pos -= start;
+            start = 0;
+        }
+        if (at_eof) {
+            return false;
+        }
+        if (len == capacity) {
+            has_failed = true;
+            return false;
+        }
+
+        ssize_t n;
+        do {
+            n = read(fd, buf + len, capacity - len);
+        } while (n < 0 && errno == EINTR);
+
+        if (n <= 0) {
+            at_eof = true;
+            has_failed = n < 0;
+            return false;
+        }
+        len += (size_t)n;
+        return true;
+    }
+
+    int fd;
+    size_t capacity;
+    MemoryResource* resource;
+    char* buf;
+    size_t len = 0;
+    size_t pos = 0;
+    bool at_eof = false;
+    bool has_failed = false;
+};
+
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Environment
+////////////////////////////////////////////////////////////////////////////////
+
+// An environment block ("NAME=value" strings, null terminated) hashed by
+// name in one pass, so resolving many variables doesn't rescan it for each
+// one, as getenv does. Entries point into the block, so the index is only
+// good until the environment changes. Like getenv, the first of duplicate
+// names wins.
+class EnvIndex {
+public:
+    explicit EnvIndex(MemoryResource& resource=*new_delete_resource())
+    : slots(Allocator<Slot>(&resource)) {}
+
+    void build(const char* const* envp) {
+        size_t n = 0;
+        for (const char* const* e = envp; e && *e; e++) { n++; }
+
+        size_t size = 16;
+        while (size < 2 * n) { size *= 2; }
+        mask = size - 1;
+        slots.assign(size, Slot());
+
+        for (const char* const* e = envp; e && *e; e++) {
+            const char* eq = strchr(*e, '=');
+            if (!eq) {
+                continue;
+            }
+            StringView name = StringView::from_range(*e, eq);
+            size_t i = (size_t)detail::hash_key(name.data(), name.size()) & mask;
+            while (slots[i].name && slots[i].name_view() != name) {
+                i = (i + 1) & mask;
+            }
+            if (!slots[i].name) {
+                slots[i].name = *e;
+                slots[i].name_len = (uint32_t)name.size();
+                slots[i].value = eq + 1;
+            }
+        }
+    }
+
+    bool find(StringView name, StringView& value) const {
+        if (slots.empty()) {
+            return false;
+        }
+        size_t i = (size_t)detail::hash_key(name.data(), name.size()) & mask;
+        while (slots[i].name) {
+            if (slots[i].name_view() == name) {
+                value = slots[i].value;
+                return true;
+            }
+            i = (i + 1) & mask;
+        }
+        return false;
+    }
+
+private:
+    struct Slot {
+        const char* name = nullptr;
+        uint32_t name_len = 0;
+        const char* value = nullptr;
+
+        StringView name_view() const { return StringView::from_range(name, name + name_len); }
+    };
+
+    Vector<Slot> slots;
+    size_t mask = 0;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Parser 
+////////////////////////////////////////////////////////////////////////////////
+
+// A short key's target: a KVArgBase or FlagArg pointer with the kind in its
+// low bits (both are at least 4-byte aligned), so resolving a short key is a
+// single load.
+class ShortKey {
+    static_assert(alignof(KVArgBase) >= 4 && alignof(FlagArg) >= 4, "ShortKey needs two tag bits");
+
+public:
+    enum Kind { INVALID = 0, KV = 1, FLAG = 2, HELP = 3 };
+
+    ShortKey() = default;
+    explicit ShortKey(KVArgBase* kv) : bits((uintptr_t)kv | KV) {}
+    explicit ShortKey(FlagArg* flag) : bits((uintptr_t)flag | FLAG) {}
+
+    static ShortKey help() {
+        ShortKey key;
+        key.bits = HELP;
+        return key;
+    }
+
+    Kind kind() const { return (Kind)(bits & 3); }
+    KVArgBase* kv() const { return (KVArgBase*)(bits & ~(uintptr_t)3); }
+    FlagArg* flag() const { return (FlagArg*)(bits & ~(uintptr_t)3); }
+
+private:
+    uintptr_t bits = 0;
+};
+
+
+// One command line in a batch. argv[0] is skipped.
+struct CommandLine {
+    int argc;
+    const char** argv;
+};
+
+// A value given on a batched command line: the argument's id (see
+// ArgBase::get_id) and its unconverted text, which points into the command
+// line. Flags have empty text.
+struct BatchValue {
+    const char* ptr;
+    uint32_t size;
+    uint32_t arg;
+
+    StringView text() const { return StringView::from_range(ptr, ptr + size); }
+};
+
+// The outcome of parsing one batched command line. Its values are the
+// count BatchValues at first in the store of the worker that parsed it.
+struct BatchRecord {
+    Status status = Status::SUCCESS;
+    StringView item;
+    uint32_t store = 0;
+    uint32_t first = 0;
+    uint32_t count = 0;
+
+    operator bool() const { return status == Status::SUCCESS; }
+};
+
+class BatchResult {
+public:
+    size_t size() const { return records.size(); }
+    const BatchRecord& operator[](size_t i) const { return records[i]; }
+
+    // Line i's values, in command line order
+    const BatchValue* begin(size_t i) const {
+        return stores[records[i].store].data() + records[i].first;
+    }
+    const BatchValue* end(size_t i) const {
+        return begin(i) + records[i].count;
+    }
+
+    bool found(size_t i, const ArgBase& arg) const {
+        for (const BatchValue* v = begin(i); v != end(i); v++) {
+            if (v->arg == arg.get_id()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The last value line i gave arg, or "" if it gave none
+    StringView raw(size_t i, const ArgBase& arg) const {
+        for (const BatchValue* v = end(i); v != begin(i); v--) {
+            if (v[-1].arg == arg.get_id()) {
+                return v[-1].text();
+            }
+        }
+        return StringView();
+    }
+
+    // The last value line i gave arg, converted, or def if it gave none.
+    // Values were checked while parsing, so conversion can't fail here.
+    template<typename T>
+    T value_or(size_t i, const ArgBase& arg, T def) const {
+        if (!found(i, arg)) {
+            return def;
+        }
+        T val{};
+        Converter<T>::parse(raw(i, arg), val);
+        return val;
+    }
+
+private:
+    friend class Schema;
+
+    std::vector<BatchRecord> records;
+    // One per worker, so workers never share a growing vector
+    std::vector<std::vector<BatchValue>> stores;
+};
+
+
+// What a token was read as, for ParseStats
+enum class TokenKind {
+    LONG,           // --key
+    LONG_EQ,        // --key=value
+    SHORT,          // -k or -kvalue
+    VALUE,          // the value after --key or -k
+    POSITIONAL,
+    VARARG,
+    DOUBLE_DASH,
+    RESPONSE_FILE,  // @path
+    COMMAND         // a subcommand's name
+};
+
+static const size_t token_kind_count = (size_t)TokenKind::COMMAND + 1;
+
+// Where parse() spends its time, for a ParseState given one (see
+// ParseState::set_stats). Everything adds up across parses until reset().
+// Without one, the parser's hooks are empty functions of detail::NoStats
+// and compile away; with one, every lookup and conversion is timed, which
+// costs two clock reads each. parse_batch() isn't instrumented.
+struct ParseStats {
+    uint64_t parses = 0;
+    uint64_t tokens[token_kind_count] = {};
+
+    // Long and short key lookups, and the hash slots or table entries they
+    // read (always one for a short key)
+    uint64_t lookups = 0;
+    uint64_t probes = 0;
+
+    // Command-line values by type. Environment and config file values
+    // aren't counted.
+    uint64_t conversions[value_type_count] = {};
+    uint64_t conversion_failures = 0;
+    // Text copied into std::string values
+    uint64_t bytes_copied = 0;
+    // Through the ParseState's MemoryResource (the heap, by default). What
+    // values allocate themselves, as std::string and VarArg do, isn't seen.
+    uint64_t allocations = 0;
+
+    // Monotonic nanoseconds. Registration is what parse() builds on the way:
+    // selected subcommands' schemas and the abbreviation index. (Registering
+    // arguments happens before parse(), in their constructors.) Tokenization
+    // is the scan over the tokens, less the lookups, conversions and usage
+    // printing inside it. Lookup only times long keys; a short key is one
+    // table read.
+    uint64_t registration_ns = 0;
+    uint64_t tokenization_ns = 0;
+    uint64_t lookup_ns = 0;
+    uint64_t conversion_ns = 0;
+    uint64_t usage_ns = 0;
+
+    void reset() {
+        *this = ParseStats();
+    }
+
+    uint64_t total_tokens() const {
+        uint64_t n = 0;
+        for (uint64_t count : tokens) { n += count; }
+        return n;
+    }
+
+    uint64_t total_conversions() const {
+        uint64_t n = 0;
+        for (uint64_t count : conversions) { n += count; }
+        return n;
+    }
+
+    void print(FILE* out=stderr) const {
+        static const char* const token_names[token_kind_count] = {
+            "long", "long=", "short", "value", "positional", "vararg", "--", "@file", "command"
+        };
+        static const char* const type_names[value_type_count] = {
+            "integer", "float", "string", "view", "lazy", "other"
+        };
+        fprintf(out, "parses %llu, tokens %llu (", (unsigned long long)parses, (unsigned long long)total_tokens());
+        for (size_t i = 0; i < token_kind_count; i++) {
+            fprintf(out, "%s%s %llu", i ? ", " : "", token_names[i], (unsigned long long)tokens[i]);
+        }
+        fprintf(out, ")\nlookups %llu, probes %llu\nconversions %llu (", 
+                (unsigned long long)lookups, (unsigned long long)probes, (unsigned long long)total_conversions());
+        for (size_t i = 0; i < value_type_count; i++) {
+            fprintf(out, "%s%s %llu", i ? ", " : "", type_names[i], (unsigned long long)conversions[i]);
+        }
+        fprintf(out, "), failures %llu, bytes copied %llu\nallocations %llu\n",
+                (unsigned long long)conversion_failures, (unsigned long long)bytes_copied, (unsigned long long)allocations);
+        fprintf(out, "us: registration %.1f, tokenization %.1f, lookup %.1f, conversion %.1f, usage %.1f\n",
+                registration_ns / 1e3, tokenization_ns / 1e3, lookup_ns / 1e3, conversion_ns / 1e3, usage_ns / 1e3);
+    }
+};
+
+
+namespace detail {
+
+inline uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Adds the time until it goes out of scope to one of stats's times. Reads
+// no clock if stats is null.
+class PhaseTimer {
+public:
+    PhaseTimer(ParseStats* _stats, uint64_t ParseStats::*_field) 
+    : stats(_stats), field(_field), start(_stats ? now_ns() : 0) {}
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer() {
+        if (stats) { stats->*field += now_ns() - start; }
+    }
+
+private:
+    ParseStats* stats;
+    uint64_t ParseStats::*field;
+    uint64_t start;
+};
+
+// The parser's instrumentation hooks, as a policy of the sinks below. These
+// do nothing, so parsing without a ParseStats compiles as if they weren't
+// there.
+struct NoStats {
+    struct Timer {
+        Timer(NoStats, uint64_t ParseStats::*) {}
+    };
+    struct ScanTimer {
+        explicit ScanTimer(NoStats) {}
+    };
+
+    void token(TokenKind) {}
+    void lookup() {}
+    void probe() {}
+    void converted(const ArgBase*, StringView, bool) {}
+    void converted_all(const ArgBase*, const StringView*, size_t, bool) {}
+};
+
+// Hooks that fill in a ParseStats
+struct CountStats {
+    explicit CountStats(ParseStats* _out) : out(_out) {}
+
+    struct Timer : PhaseTimer {
+        Timer(CountStats stats, uint64_t ParseStats::*field) : PhaseTimer(stats.out, field) {}
+    };
+
+    // Tokenization: the scan's time, less the timers inside it
+    class ScanTimer {
+    public:
+        explicit ScanTimer(CountStats stats) : out(stats.out), start(now_ns()), nested(inner()) {}
+
+        ScanTimer(const ScanTimer&) = delete;
+        ScanTimer& operator=(const ScanTimer&) = delete;
+
+        ~ScanTimer() {
+            out->tokenization_ns += (now_ns() - start) - (inner() - nested);
+        }
+
+    private:
+        uint64_t inner() const {
+            return out->registration_ns + out->lookup_ns + out->conversion_ns + out->usage_ns;
+        }
+
+        ParseStats* out;
+        uint64_t start;
+        uint64_t nested;
+    };
+
+    void token(TokenKind kind) { out->tokens[(size_t)kind]++; }
+    void lookup() { out->lookups++; }
+    void probe() { out->probes++; }
+
+    void converted(const ArgBase* arg, StringView value, bool good) {
+        ValueType type = arg->value_type();
+        out->conversions[(size_t)type]++;
+        out->conversion_failures += !good;
+        if (good && type == ValueType::STRING) {
+            out->bytes_copied += value.size();
+        }
+    }
+
+    // The first n of toks converted; if not good, the one after them didn't
+    void converted_all(const ArgBase* arg, const StringView* toks, size_t n, bool good) {
+        ValueType type = arg->value_type();
+        out->conversions[(size_t)type] += n + !good;
+        out->conversion_failures += !good;
+        if (type == ValueType::STRING) {
+            for (size_t i = 0; i < n; i++) { out->bytes_copied += toks[i].size(); }
+        }
+    }
+
+    ParseStats* out;
+};
+
+// Where Schema's parsing functions put values. ApplySink stores them in the
+// registered arguments; RecordSink only checks that they convert and records
+// their text, which is what lets a shared Schema parse on many threads.
+// Both carry a stats policy (NoStats or CountStats) for the parser's hooks.
+template<typename StatsT=NoStats>
+struct ApplySink {
+    typedef StatsT Stats;
+
+    // May print usage for --help and expand response files
+    static const bool interactive = true;
+
+    explicit ApplySink(Stats _stats=Stats()) : stats(_stats) {}
+
+    Stats stats;
+
+    // If set, vararg tokens are collected here to convert in runs (see
+    // Schema::enable_deferred_varargs)
+    Vector<StringView>* deferred = nullptr;
+
+    // Whether tokens outlive the scan, so arguments may keep them
+    bool stable = true;
+
+    // fn is the argument's ArgBase::convert, if it has one
+    bool kv(KVArgBase* arg, StringView value, ConvertFn fn) {
+        typename Stats::Timer timer(stats, &ParseStats::conversion_ns);
+        bool good = !stable ? arg->parse_now(value) : fn ? fn(arg, value) : arg->parse(value);
+        stats.converted(arg, value, good);
+        return good;
+    }
+    void flag(FlagArg* arg) { arg->parse(); }
+    bool pos(PosArgBase* arg, StringView value, ConvertFn fn) {
+        typename Stats::Timer timer(stats, &ParseStats::conversion_ns);
+        bool good = fn ? fn(arg, value) : arg->parse(value);
+        stats.converted(arg, value, good);
+        return good;
+    }
+    bool var(VarArgBase* arg, StringView value) {
+        if (deferred) {
+            deferred->push_back(value);
+            return true;
+        }
+        typename Stats::Timer timer(stats, &ParseStats::conversion_ns);
+        bool good = arg->parse(value);
+        stats.converted(arg, value, good);
+        return good;
+    }
+    // Converts the collected vararg tokens, if any. On failure bad is the
+    // first that didn't convert.
+    bool flush(VarArgBase* arg, ThreadPool* pool, StringView& bad) {
+        if (!deferred || deferred->empty()) {
+            return true;
+        }
+        typename Stats::Timer timer(stats, &ParseStats::conversion_ns);
+        size_t n = deferred->size();
+        size_t i = n;
+        bool good = arg->parse_all(deferred->data(), n, pool, i);
+        stats.converted_all(arg, deferred->data(), good ? n : i, good);
+        if (!good) {
+            bad = (*deferred)[i];
+        }
+        deferred->clear();
+        return good;
+    }
+};
+
+struct RecordSink {
+    typedef NoStats Stats;
+
+    static const bool interactive = false;
+
+    Stats stats;
+
+    std::vector<BatchValue>* out = nullptr;
+
+    bool kv(KVArgBase* arg, StringView value, ConvertFn) { return record(arg, arg->check(value), value); }
+    void flag(FlagArg* arg) { record(arg, true, StringView()); }
+    bool pos(PosArgBase* arg, StringView value, ConvertFn) { return record(arg, arg->check(value), value); }
+    bool var(VarArgBase* arg, StringView value) { return record(arg, arg->check(value), value); }
+    bool flush(VarArgBase*, ThreadPool*, StringView&) { return true; }
+
+    bool record(const ArgBase* arg, bool good, StringView value) {
+        if (good) {
+            BatchValue v;
+            v.ptr = value.data();
+            v.size = (uint32_t)value.size();
+            v.arg = arg->get_id();
+            out->push_back(v);
+        }
+        return good;
+    }
+};
+
+} // namespace detail
+
+
+// Everything that changes while parsing one command line. Reusable: each
+// Schema::parse() starts by resetting it, and its storage (including any
+// response file mappings from the last parse) is recycled rather than
+// reallocated.
+class ParseState {
+public:
+    explicit ParseState(bool _silent=false) 
+    : ParseState(*new_delete_resource(), _silent) {}
+
+    ParseState(MemoryResource& resource, bool _silent=false);
+
+    ParseState(const ParseState&) = delete;
+    ParseState& operator=(const ParseState&) = delete;
+
+    ~ParseState();
+
+    // Where environment variables are read from (see KVArgBase::set_env),
+    // in place of the process environment, or null (the default) for the
+    // process environment
+    void set_environ(const char* const* _envp) {
+        envp = _envp;
+    }
+
+    // A "key = value" file to fill in what the command line and environment
+    // don't (see Schema::parse), or null for none
+    void set_config_file(const char* path) {
+        config_path = path;
+    }
+
+    // Where parse() adds up its counters and times, or null (the default)
+    // for none. stats must outlive the parses that use it. Allocations are
+    // only counted while stats are set: the next parse moves the state's
+    // storage on or off the counting resource, so values from the last
+    // parse stay good until then.
+    void set_stats(ParseStats* _stats) {
+        stats = _stats;
+    }
+
+    void reset(TokenSource& _source) {
+        unmap_files();
+        bad_file = StringView();
+        MemoryResource* resource = stats ? &counted : counted.get_upstream();
+        if (vararg_tokens.get_allocator().get_resource() != resource) {
+            bind(resource);
+        }
+        source = &_source;
+        pending = StringView();
+        pos_arg_idx = 0;
+        saw_double_dash = false;
+        vararg_tokens.clear();
+        command = nullptr;
+    }
+
+    // Next token from the innermost open response file, or from the source
+    // once they're all exhausted. False, with input_failed() set, at a
+    // malformed response file (see detail::next_quoted_token).
+    bool next_token(StringView& tok) {
+        if (pending.data()) {
+            tok = pending;
+            pending = StringView();
+            return true;
+        }
+#if defined(ARGS_POSIX)
+        while (!open_files.empty()) {
+            auto& file = files[open_files.back()];
+            bool unterminated;
+            if (detail::next_quoted_token(file.cur, file.end, tok, unterminated)) {
+                return true;
+            }
+            if (unterminated) {
+                bad_file = file.path;
+                return false;
+            }
+            open_files.pop_back();
+        }
+#endif
+        return source->next(tok);
+    }
+
+    // Whether the tokens stopped on an error: a malformed response file, or
+    // a failed source (see TokenSource::failed)
+    bool input_failed() const {
+        return bad_file.data() || source->failed();
+    }
+
+private:
+    friend class Schema;
+
+    void unmap_files();
+
+    // Rebuilds the state's containers empty, allocating from resource. Only
+    // between parses, with the files unmapped.
+    void bind(MemoryResource* resource);
+
+    // Over the state's resource, for ParseStats::allocations. The containers
+    // only allocate through it while stats are set.
+    CountingResource counted;
+
+    ArgvSource argv_source;
+    TokenSource* source = nullptr;
+    // A token read ahead and put back, which next_token returns first
+    StringView pending;
+    bool silent = false;
+    ParseStats* stats = nullptr;
+
+    uint32_t pos_arg_idx = 0;
+    bool saw_double_dash = false;
+    Vector<StringView> vararg_tokens;
+    // The subcommand the scan stopped at, which the rest of the tokens are for
+    SubcommandBase* command = nullptr;
+
+    // Set by set_environ; null reads the process environment as it is at
+    // each parse
+    const char* const* envp = nullptr;
+    EnvIndex env_index;
+
+    const char* config_path = nullptr;
+    char* config_base = nullptr;
+    size_t config_size = 0;
+    // By argument id, whether the command line or environment gave it
+    Vector<uint8_t> given;
+
+    StringView suggestions[Result::max_suggestions];
+
+#if defined(ARGS_POSIX)
+    struct ResponseFile {
+        // As given after the @. The source isn't read again until the file
+        // is done, so even a path from FdSource is good while it's read.
+        StringView path;
+        char* base = nullptr;
+        size_t size = 0;
+        char* cur = nullptr;
+        char* end = nullptr;
+        dev_t dev = 0;
+        ino_t ino = 0;
+    };
+    // Every file mapped so far, and the stack of ones still being read
+    Vector<ResponseFile> files;
+    Vector<size_t> open_files;
+#endif
+    // The response file with an unterminated quote, if any
+    StringView bad_file;
+};
+
+
+// For Schema::completion_script
+enum class Shell {
+    BASH,
+    ZSH
+};
+
+
+// The registered arguments, validated and indexed once. Parsing never
+// modifies the schema itself, only the registered arguments' values and the
+// ParseState passed in, so one schema can parse any number of command lines:
+//
+//     Schema schema("server");
+//     KVArg<int> port(schema, "port", "p", "Port");
+//     ParseState state;
+//     for (...) {
+//         if (schema.parse(argc, argv, state)) { use(*port); }
+//     }
+class Schema : public ParserBase {
+public:
+    // All of the schema's internal state lives in resource, which must
+    // outlive it. With an Arena, neither setup nor parse() touches the heap
+    // (VarArg values are still kept in a std::vector, and a Subcommand's
+    // objects on the heap when first selected).
+    explicit Schema(const char* _app_name, MemoryResource& resource=*new_delete_resource());
+    ~Schema();
+
+    Schema(const Schema&) = delete;
+    Schema& operator=(const Schema&) = delete;
+
+    // The resource passed to the constructor
+    MemoryResource& get_resource() const {
+        return *args.get_allocator().get_resource();
+    }
+
+// Adding arguments
+//////////////////////////////////////////////////////////////////////////////
+    void add_pos_arg(PosArgBase *pos_arg) override;
+
+    void add_vararg(VarArgBase *_vararg) override;
+
+    void add_kv_arg(KVArgBase *kv_arg) override;
+
+
+    void add_flag_arg(FlagArg *flag_arg) override;
+
+    // Only the name is stored: a subcommand's schema isn't built until it's
+    // selected
+    void add_subcommand(SubcommandBase* subcommand) override;
+
+
+    // Routes long keys through a perfect hash instead of the key maps. Must
+    // be called before any keyed argument is added, and every keyed
+    // argument's long key must then be in the table.
+    template<size_t N>
+    void set_key_table(const KeyTable<N>& table) {
+        if (!table.valid()) {
+            return config_error("Parser config error: key table has duplicate keys");
+        }
+        if (!kv_keys.empty() || !flag_keys.empty()) {
+            return config_error("Parser config error: key table must be set before adding keyed arguments");
+        }
+        key_table = table.ref();
+        key_table_args.assign(N, KeyTableEntry());
+    }
+
+
+    // Reports config errors (a duplicate key, say) instead of printing them
+    // and exiting: the argument at fault isn't added, the first error is
+    // kept (see config_error_message), and every parse() returns it as a
+    // CONFIG_ERROR. Parsing is also silent whatever the ParseState says,
+    // --help and --args-complete included, so nothing in the schema does
+    // any I/O. Subcommands' schemas inherit it. For tests and fuzzing, where
+    // a bad schema mustn't end the process.
+    void enable_no_exit(bool enable=true) {
+        no_exit = enable;
+    }
+
+    // The first config error recorded in no-exit mode, or null
+    const char* config_error_message() const {
+        return first_config_error[0] ? first_config_error : nullptr;
+    }
+
+
+    // Expands @path tokens into the whitespace-separated tokens of the file
+    // at path (see detail::next_quoted_token for quoting). Files are mapped
+    // rather than read, tokens point into the mapping, and mappings stay
+    // until the ParseState is reset or destroyed. Response files may include
+    // others, but not themselves, and a quote left open is a
+    // RESPONSE_FILE_ERROR. Off by default, since "@" is otherwise an ordinary
+    // first character for a positional. POSIX only.
+    void enable_response_files(bool enable=true) {
+        response_files = enable;
+    }
+
+    // Converts the vararg's values a run at a time instead of as they're
+    // read: its tokens are collected until the next key (or response file,
+    // or the end), then converted in one go into storage reserved for the
+    // run, and with a pool, long runs are converted in chunks across the
+    // pool's threads. Nothing after a run is acted on before it converts, so
+    // errors, and which arguments end up found, are the same as converting
+    // one at a time. Only takes effect for sources whose tokens stay valid
+    // (TokenSource::stable), and pool must not be running anything else
+    // during parse().
+    void enable_deferred_varargs(ThreadPool* pool=nullptr) {
+        deferred_varargs = true;
+        vararg_pool = pool;
+    }
+
+    // Accepts an unambiguous prefix of a long key, as argparse's allow_abbrev
+    // does. An exact key always wins; a prefix of several keys is an
+    // AMBIGUOUS_KEY error.
+    void enable_abbreviations(bool enable=true) {
+        abbreviations = enable;
+    }
+
+    // Makes a command line starting with "--args-complete <word>" a request
+    // for completions: the words after it are the ones before the cursor,
+    // and only select subcommands. parse() then prints the completions of
+    // word for the last subcommand selected (see print_completions) and
+    // returns COMPLETED, with no argument given. Anywhere else the key means
+    // nothing special. This is what the scripts from completion_script call
+    // on each keystroke.
+    void enable_completion(bool enable=true);
+
+
+// Parsing arguments
+//////////////////////////////////////////////////////////////////////////////
+
+    // Resets state and every registered argument, then parses the tokens of
+    // source (which must outlive the values read from it). Arguments the
+    // tokens don't give then come from their environment variables (see
+    // KVArgBase::set_env), and after that from state's config file (see
+    // apply_config_file).
+    //
+    // If a subcommand is selected, the tokens after it are parsed with its
+    // schema the same way (the config file aside, which is only for this
+    // schema's arguments), and so on for its own subcommands.
+    Result parse(TokenSource& source, ParseState& state) const;
+
+    // Skips argv[0], which must outlive the values read from argv.
+    Result parse(int argc, const char** argv, ParseState& state) const {
+        state.argv_source = ArgvSource(argc, argv);
+        return parse(state.argv_source, state);
+    }
+
+    // After a successful parse, converts every lazy argument's value (see
+    // LazyKVArg), in the selected subcommands too, and reports the first
+    // that doesn't convert, as parse() would have if it had converted them.
+    Result validate_all(const ParseState& state) const;
+
+private:
+    // Parses state's tokens up to the end or a subcommand, then applies the
+    // environment. Must be called with state positioned at this schema's
+    // first token. The scan is instrumented only if state has a ParseStats.
+    Result parse_tokens(ParseState& state) const;
+
+    template<typename Stats>
+    Result parse_tokens(ParseState& state, Stats stats) const;
+
+    // The rest of a parse whose first token, first, was --args-complete (see
+    // enable_completion)
+    Result complete(StringView first, ParseState& state) const;
+
+public:
+
+#if !defined(ARGS_NO_THREADS)
+    // Parses count command lines on pool's threads. The registered arguments
+    // aren't touched: each line gets a BatchRecord listing its raw values,
+    // which have already been checked to convert. Nothing is printed, and
+    // @path tokens are a RESPONSE_FILE_ERROR when response files are enabled,
+    // since a line's values must outlive its parse. lines must outlive the
+    // result. Schemas with subcommands can't be batched.
+    BatchResult parse_batch(const CommandLine* lines, size_t count, ThreadPool& pool) const;
+
+    BatchResult parse_batch(const std::vector<CommandLine>& lines, ThreadPool& pool) const {
+        return parse_batch(lines.data(), lines.size(), pool);
+    }
+#endif
+
+    // Parses the rest of state's tokens, handing values to sink
+    template<typename Sink>
+    Result scan(ParseState& state, Sink& sink) const;
+
+    // Functions that need a value pull it from the source themselves. After
+    // that the key's token may be gone (see TokenSource), so errors name the
+    // key as it was registered.
+    template<typename Sink>
+    Result parse_long_arg(StringView arg, ParseState& state, Sink& sink) const;
+
+
+    template<typename Sink>
+    Result parse_short_arg(StringView arg, ParseState& state, Sink& sink) const;
+
+    template<typename Sink>
+    Result parse_positional_arg(StringView arg, ParseState& state, Sink& sink) const;
+
+    template<typename Sink>
+    Result parse_vararg(StringView arg, ParseState& state, Sink& sink) const;
+
+    // Converts the vararg tokens collected so far (see
+    // enable_deferred_varargs)
+    template<typename Sink>
+    Result flush_varargs(ParseState& state, Sink& sink) const;
+
+    Result vararg_error(StringView arg, ParseState& state) const;
+
+    Result open_response_file(StringView path, ParseState& state) const;
+
+    // Sets kv_arg or flag_arg, and for a kv_arg with one, its conversion
+    void find_long_key(StringView key, KVArgBase*& kv_arg, FlagArg*& flag_arg, detail::ConvertFn* convert=nullptr) const;
+
+    template<typename Stats>
+    void find_long_key(StringView key, KVArgBase*& kv_arg, FlagArg*& flag_arg, detail::ConvertFn* convert, Stats stats) const;
+
+    // The registry entry for a long key, or -1. Slots carry the top half of
+    // their key's hash, so a probe only reads a key's bytes when that
+    // matches: usually one slot, one offset and length, and the bytes.
+    template<typename Stats>
+    long find_registered(StringView key, Stats stats) const;
+
+    void register_key(StringView key, ShortKey::Kind kind, ArgBase* arg);
+
+    void insert_registered(uint32_t entry);
+
+    // The usage text is rendered once, on first use, and cached; adding an
+    // argument discards it. Not thread-safe until it's been rendered.
+    void print_usage() const {
+        StringView text = usage_text();
+        detail::write_all(stderr, text.data(), text.size());
+    }
+
+    StringView usage_text() const;
+
+
+// Completion
+//////////////////////////////////////////////////////////////////////////////
+
+    // The long keys (without dashes) that start with prefix, in byte order.
+    // Writes up to max_out of them to out and returns how many there are.
+    // The key index is built on first use and kept until an argument is
+    // added; after that this is two binary searches and never allocates.
+    size_t complete(StringView prefix, StringView* out, size_t max_out) const;
+
+    // The long keys (without dashes, --help included) nearest to key by edit
+    // distance, closest first. Writes up to max_out (at most
+    // Result::max_suggestions) of them to out and returns how many it wrote.
+    // Keys more than half of key's length away (at least 1, at most 3) aren't
+    // suggested, and neither is anything for a key longer than 64 bytes.
+    size_t suggest(StringView key, StringView* out, size_t max_out) const;
+
+    // Prints the completions of a command line word to stdout, one per line,
+    // with a single write: the long keys it's a prefix of (--help included)
+    // for "", "-" or "--...", and the subcommands it's a prefix of for other
+    // words. With neither, nothing, so the shell can fall back to file names.
+    void print_completions(StringView word) const;
+
+    // A completion script for shell that asks the program itself (through
+    // --args-complete, see enable_completion) for candidates, so it never
+    // goes stale. The words before the cursor are passed along after the
+    // word to complete, so a subcommand completes its own keys. Source it
+    // from the shell's startup file, or install it where the shell looks for
+    // completions.
+    std::string completion_script(Shell shell) const;
+
+private:
+    const char* app_name;
+
+    // Every registered argument, in registration order
+    Vector<ArgBase*> args;
+
+    // print_usage(), timed for state's ParseStats
+    void print_usage(const ParseState& state) const {
+        detail::PhaseTimer timer(state.stats, &ParseStats::usage_ns);
+        print_usage();
+    }
+
+    // Lowest precedence layer: one "key = value" per line, whitespace around
+    // either ignored, and blank lines and lines starting with # skipped. A
+    // flag's value reads as for its environment variable, and a flag's key
+    // alone sets it. Values only go to arguments the command line and
+    // environment didn't give, and the last line for a key wins. The file is
+    // mapped, keys resolve as long keys do, and values are views into the
+    // mapping (kept until the state is reset), so nothing is copied.
+    Result apply_config_file(ParseState& state) const;
+
+    // Gives arguments that weren't on the command line their environment
+    // variable's value, if set. The environment is indexed once, and only if
+    // some argument needs it. Without an environment block, falls back to
+    // getenv.
+    Result apply_env(ParseState& state) const;
+
+    Vector<PosArgBase*> pos_args;
+
+    Map<StringView, KVArgBase*> kv_keys;
+    Map<StringView, FlagArg*> flag_keys;
+
+    // Indexed by the short key's byte
+    ShortKey short_keys[256];
+
+    VarArgBase* vararg = nullptr;
+
+    struct KeyTableEntry {
+        KVArgBase* kv = nullptr;
+        FlagArg* flag = nullptr;
+    };
+    KeyTableRef key_table;
+    Vector<KeyTableEntry> key_table_args;
+
+    bool response_files = false;
+
+    bool deferred_varargs = false;
+    ThreadPool* vararg_pool = nullptr;
+
+    // Rendered usage text, or empty until print_usage needs it
+    mutable Vector<char> usage;
+
+    bool abbreviations = false;
+    bool completion = false;
+
+    // Every long key, sorted bytewise and packed into key_bytes, for prefix
+    // searches. Built when first needed, and rebuilt after an argument is
+    // added.
+    struct KeyIndexEntry {
+        uint32_t offset;
+        uint32_t size;
+        KVArgBase* kv;
+        FlagArg* flag;
+    };
+    mutable Vector<char> key_bytes;
+    mutable Vector<KeyIndexEntry> key_index;
+    mutable bool key_index_ready = false;
+
+    // Subcommands in registration order, and hashed by name (open
+    // addressing, at most half full)
+    struct CommandSlot {
+        const char* name = nullptr;
+        uint32_t size = 0;
+        SubcommandBase* command = nullptr;
+    };
+    Vector<SubcommandBase*> commands;
+    Vector<CommandSlot> command_slots;
+
+    // The keyed arguments again, as parallel arrays for lookups while
+    // parsing (see find_registered): a hash table of entries, and by entry
+    // the key's offset into the packed key bytes, its length, the
+    // argument's kind (a ShortKey::Kind), and its conversion paired with its
+    // pointer. The maps above stay for registration checks and usage, which
+    // want them sorted. Kept current as arguments are added, so parsing
+    // never builds anything.
+    struct RegistryTarget {
+        detail::ConvertFn convert;
+        ArgBase* arg;
+    };
+    Vector<uint64_t> reg_slots;
+    Vector<char> reg_bytes;
+    Vector<uint32_t> reg_offsets;
+    Vector<uint32_t> reg_lens;
+    Vector<uint8_t> reg_kinds;
+    Vector<RegistryTarget> reg_targets;
+
+    bool no_exit = false;
+    char first_config_error[256] = {};
+
+    bool silent(const ParseState& state) const {
+        return state.silent || no_exit;
+    }
+
+    template<typename T> friend class Subcommand;
+
+    void register_arg(ArgBase* arg);
+
+    void insert_command(SubcommandBase* command);
+
+    SubcommandBase* find_command(StringView name) const;
+
+    Result invalid_command(StringView name, ParseState& state) const;
+
+    // The tokens stopped on an error (see ParseState::input_failed)
+    Result input_error(ParseState& state) const;
+
+    StringView index_key(const KeyIndexEntry& entry) const {
+        const char* p = key_bytes.data() + entry.offset;
+        return StringView::from_range(p, p + entry.size);
+    }
+
+    // Bytewise order, shorter first on a tie. (StringView's operator< orders
+    // a prefix after the longer string, which would split prefix ranges.)
+    static bool key_less(StringView a, StringView b) {
+        size_t n = std::min(a.size(), b.size());
+        int c = n ? memcmp(a.data(), b.data(), n) : 0;
+        return c != 0 ? c < 0 : a.size() < b.size();
+    }
+
+    void build_key_index() const;
+
+    // [begin, end) of the key_index entries that start with prefix
+    void prefix_range(StringView prefix, size_t& begin, size_t& end) const;
+
+    void append(StringView s) const {
+        usage.insert(usage.end(), s.data(), s.data() + s.size());
+    }
+
+    // Pads the row whose left column started at row_start out to width,
+    // then adds its description
+    void end_row(size_t row_start, StringView desc, size_t width) const {
+        usage.insert(usage.end(), row_start + width - usage.size(), ' ');
+        append(desc);
+        append("\n");
+    }
+
+    void render_usage() const;
+
+
+    // k's index in the key table, or -1 after a config error
+    long table_index(StringView k, const char* name);
+
+    bool check_short_key(StringView short_k, const char* name);
+
+    // panic()s, or in no-exit mode keeps the first error for parse() to
+    // return
+    ARGS_PRINTF_FORMAT(2, 3) void config_error(const char* fmt, ...);
+};
+
+
+// A subcommand whose arguments are the members of T, which is constructed
+// from the subcommand's own Schema. Neither is built until the subcommand is
+// selected, so a tool's startup cost is its selected subcommand's arguments,
+// not every subcommand's:
+//
+//     struct Commit {
+//         KVArg<std::string> message;
+//         FlagArg amend;
+//         explicit Commit(Schema& schema)
+//         : message(schema, "message", "m", "Commit message"),
+//           amend(schema, "amend", "", "Replace the last commit") {}
+//     };
+//
+//     Parser parser("git", argc, argv);
+//     Subcommand<Commit> commit(parser, "commit", "Record changes");
+//     ...
+//     if (parser.parse() && commit) { use(commit->message); }
+//
+// The subcommand's schema starts with its parent's settings (response
+// files, abbreviations and so on) and allocates from its parent's
+// MemoryResource, and once built is kept for later parses. The Schema and T
+// objects themselves, and the schema's name, are still on the heap, once.
+template<typename T>
+class Subcommand : public SubcommandBase {
+public:
+    Subcommand(ParserBase& parser, const char* _name, const char *_desc) 
+    : SubcommandBase(parser, _name, _desc) {}
+
+    T& value() {
+        assert(was_found);
+        return *options;
+    }
+
+    const T& value() const {
+        assert(was_found);
+        return *options;
+    }
+
+    T& operator*() { return value(); }
+    const T& operator*() const { return value(); }
+    T* operator->() { return &value(); }
+    const T* operator->() const { return &value(); }
+
+private:
+    const Schema& select(const Schema& parent) override {
+        was_found = true;
+        if (!options) {
+            full_name = std::string(parent.app_name) + " " + name;
+            schema.reset(new Schema(full_name.c_str(), parent.get_resource()));
+            schema->response_files = parent.response_files;
+            schema->deferred_varargs = parent.deferred_varargs;
+            schema->vararg_pool = parent.vararg_pool;
+            schema->abbreviations = parent.abbreviations;
+            schema->completion = parent.completion;
+            schema->no_exit = parent.no_exit;
+            options.reset(new T(*schema));
+            built = schema.get();
+        }
+        return *schema;
+    }
+
+    std::string full_name;
+    // Declared before options, whose arguments it points to
+    std::unique_ptr<Schema> schema;
+    std::unique_ptr<T> options;
+};
+
+
+// A Schema bundled with the state for parsing a single command line.
+class Parser : public Schema {
+public:
+    Parser(const char* _app_name, int argc, const char **argv, bool _silent=false) 
+    : Parser(_app_name, argc, argv, *new_delete_resource(), _silent) {}
+
+    Parser(const char* _app_name, int argc, const char **argv, MemoryResource& resource, bool _silent=false) 
+    : Schema(_app_name, resource), argv_source(argc, argv), source(&argv_source), state(resource, _silent) {}
+
+    // Pulls tokens from source, which must outlive the parser.
+    Parser(const char* _app_name, TokenSource& _source, bool _silent=false) 
+    : Parser(_app_name, _source, *new_delete_resource(), _silent) {}
+
+    Parser(const char* _app_name, TokenSource& _source, MemoryResource& resource, bool _silent=false) 
+    : Schema(_app_name, resource), source(&_source), state(resource, _silent) {}
+
+    using Schema::parse;
+
+    Result parse() {
+        return Schema::parse(*source, state);
+    }
+
+    void set_config_file(const char* path) {
+        state.set_config_file(path);
+    }
+
+    void set_stats(ParseStats* stats) {
+        state.set_stats(stats);
+    }
+
+    using Schema::validate_all;
+
+    Result validate_all() const {
+        return Schema::validate_all(state);
+    }
+
+private:
+    ArgvSource argv_source;
+    TokenSource* source;
+    ParseState state;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// ParseState and Schema definitions
+////////////////////////////////////////////////////////////////////////////////
+
+// Inline in the header, or with ARGS_SEPARATE_COMPILATION, compiled once
+// into libargs (args.cpp) and left out of every file including the header.
+#if !defined(ARGS_DECLARE_ONLY)
+
+ARGS_INLINE ParseState::ParseState(MemoryResource& resource, bool _silent) 
+: counted(&resource), silent(_silent), vararg_tokens(Allocator<StringView>(&resource)), env_index(resource),
+  given(Allocator<uint8_t>(&resource))
+#if defined(ARGS_POSIX)
+  , files(Allocator<ResponseFile>(&resource)), open_files(Allocator<size_t>(&resource))
+#endif
+{}
+
+ARGS_INLINE void ParseState::bind(MemoryResource* resource) {
+    vararg_tokens = Vector<StringView>(Allocator<StringView>(resource));
+    env_index = EnvIndex(*resource);
+    given = Vector<uint8_t>(Allocator<uint8_t>(resource));
+#if defined(ARGS_POSIX)
+    files = Vector<ResponseFile>(Allocator<ResponseFile>(resource));
+    open_files = Vector<size_t>(Allocator<size_t>(resource));
+#endif
+}
+
+ARGS_INLINE ParseState::~ParseState() {
+    unmap_files();
+}
+
+ARGS_INLINE void ParseState::unmap_files() {
+#if defined(ARGS_POSIX)
+    for (auto& file : files) {
+        if (file.base) { munmap(file.base, file.size); }
+    }
+    files.clear();
+    open_files.clear();
+
+    if (config_base) {
+        munmap(config_base, config_size);
+        config_base = nullptr;
+    }
+#endif
+}
+
+ARGS_INLINE Schema::Schema(const char* _app_name, MemoryResource& resource)
+: app_name(_app_name),
+  args(Allocator<ArgBase*>(&resource)),
+  pos_args(Allocator<PosArgBase*>(&resource)),
+  kv_keys(std::less<StringView>(), Allocator<std::pair<const StringView, KVArgBase*>>(&resource)),
+  flag_keys(std::less<StringView>(), Allocator<std::pair<const StringView, FlagArg*>>(&resource)),
+  key_table_args(Allocator<KeyTableEntry>(&resource)),
+  usage(Allocator<char>(&resource)),
+  key_bytes(Allocator<char>(&resource)),
+  key_index(Allocator<KeyIndexEntry>(&resource)),
+  commands(Allocator<SubcommandBase*>(&resource)),
+  command_slots(Allocator<CommandSlot>(&resource)),
+  reg_slots(Allocator<uint64_t>(&resource)),
+  reg_bytes(Allocator<char>(&resource)),
+  reg_offsets(Allocator<uint32_t>(&resource)),
+  reg_lens(Allocator<uint32_t>(&resource)),
+  reg_kinds(Allocator<uint8_t>(&resource)),
+  reg_targets(Allocator<RegistryTarget>(&resource))
+{
+    short_keys[(uint8_t)'h'] = ShortKey::help();
+}
+
+ARGS_INLINE Schema::~Schema() {}
+
+ARGS_INLINE void Schema::add_pos_arg(PosArgBase *pos_arg) {
+    if (vararg) {
+        return config_error("Parser config error: config %s: can't have positional argument after vararg", pos_arg->get_name());
+    }
+    if (!commands.empty()) {
+        return config_error("Parser config error: config %s: can't have positional arguments and subcommands", pos_arg->get_name());
+    }
+    pos_args.push_back(pos_arg);
+    register_arg(pos_arg);
+}
+
+ARGS_INLINE void Schema::add_vararg(VarArgBase *_vararg) {
+    if (vararg) {
+        return config_error("Parser config error: config %s: can't have more than one vararg", _vararg->get_name());
+    }
+    if (!commands.empty()) {
+        return config_error("Parser config error: config %s: can't have a vararg and subcommands", _vararg->get_name());
+    }
+    vararg = _vararg;
+    register_arg(_vararg);
+}
+
+ARGS_INLINE void Schema::add_kv_arg(KVArgBase *kv_arg) {
+    StringView k = kv_arg->get_key();
+    StringView short_k = kv_arg->get_short_key();
+
+    if (k == "help") {
+        return config_error("Parser config error: config %s's key cannot be \"help\" (configs with builtin help flag", kv_arg->get_name());
+    }
+
+    if (short_k == "h") {
+        return config_error("Parser config error: config %s's short key cannot be \"h\" (configs with builtin help flag", kv_arg->get_name());
+    }
+
+    if (k.size() == 0) {
+        return config_error("Parser config error: config %s's key cannot be empty", kv_arg->get_name());
+    }
+
+    if (k.find('=') != StringView::npos) {
+        return config_error("Parser config error: config %s's key cannot contain \"=\"", kv_arg->get_name());
+    }
+
+    if (kv_keys.count(k) != 0 || flag_keys.count(k) != 0) {
+        return config_error("Parser config error: config %s's long key is a duplicate", kv_arg->get_name());
+    }
+
+    if (!check_short_key(short_k, kv_arg->get_name())) {
+        return;
+    }
+
+    long table_idx = -1;
+    if (key_table.size && (table_idx = table_index(k, kv_arg->get_name())) < 0) {
+        return;
+    }
+
+    kv_keys[k] = kv_arg;
+    register_key(k, ShortKey::KV, kv_arg);
+    if (table_idx >= 0) {
+        key_table_args[table_idx].kv = kv_arg;
+    }
+    if (short_k != "") {
+        short_keys[(uint8_t)short_k[0]] = ShortKey(kv_arg);
+    }
+
+    register_arg(kv_arg);
+}
+
+ARGS_INLINE void Schema::add_flag_arg(FlagArg *flag_arg) {
+    StringView k = flag_arg->get_key();
+    StringView short_k = flag_arg->get_short_key();
+
+    if (short_k == "h") {
+        return config_error("Parser config error: config %s's short key cannot be \"h\" (configs with builtin help flag", flag_arg->get_name());
+    }
+
+    if (k.size() == 0) {
+        return config_error("Parser config error: config %s's key cannot be empty", flag_arg->get_name());
+    }
+
+    if (flag_keys.count(k) != 0 || kv_keys.count(k) != 0) {
+        return config_error("Parser config error: config %s's key is a duplicate", flag_arg->get_name());
+    }
+
+    if (!check_short_key(short_k, flag_arg->get_name())) {
+        return;
+    }
+
+    long table_idx = -1;
+    if (key_table.size && (table_idx = table_index(k, flag_arg->get_name())) < 0) {
+        return;
+    }
+
+    flag_keys[k] = flag_arg;
+    register_key(k, ShortKey::FLAG, flag_arg);
+    if (table_idx >= 0) {
+        key_table_args[table_idx].flag = flag_arg;
+    }
+    if (short_k != "") {
+        short_keys[(uint8_t)short_k[0]] = ShortKey(flag_arg);
+    }
+
+    register_arg(flag_arg);
+}
+
+ARGS_INLINE void Schema::add_subcommand(SubcommandBase* subcommand) {
+    StringView name = subcommand->get_name();
+    if (!pos_args.empty() || vararg) {
+        return config_error("Parser config error: config %s: can't have subcommands and positional arguments", subcommand->get_name());
+    }
+    if (name.size() == 0 || name[0] == '-') {
+        return config_error("Parser config error: config %s: subcommand name must be non-empty and not start with '-'", subcommand->get_name());
+    }
+    if (find_command(name)) {
+        return config_error("Parser config error: config %s: subcommand name is a duplicate", subcommand->get_name());
+    }
+
+    commands.push_back(subcommand);
+    if (2 * commands.size() > command_slots.size()) {
+        // Rehash at half full, to a power of two at most a quarter full
+        size_t size = 16;
+        while (size < 4 * commands.size()) { size *= 2; }
+        command_slots.assign(size, CommandSlot());
+        for (SubcommandBase* c : commands) {
+            insert_command(c);
+        }
+    } else {
+        insert_command(subcommand);
+    }
+    register_arg(subcommand);
+}
+
+ARGS_INLINE void Schema::enable_completion(bool enable) {
+    completion = enable;
+}
+
+ARGS_INLINE Result Schema::parse(TokenSource& source, ParseState& state) const {
+    state.reset(source);
+    uint64_t allocations = state.counted.allocations();
+    // Completion is only asked for by the first token, which is otherwise
+    // put back for the scan
+    StringView first;
+    bool completing = false;
+    if (completion && state.next_token(first)) {
+        completing = first == "--args-complete" || first.starts_with("--args-complete=");
+        if (!completing) {
+            state.pending = first;
+        }
+    }
+
+    Result res = completing ? complete(first, state) : parse_tokens(state);
+    if (res && state.config_path) {
+        res = apply_config_file(state);
+    }
+
+    const Schema* schema = this;
+    while (res && state.command) {
+        {
+            detail::PhaseTimer timer(state.stats, &ParseStats::registration_ns);
+            schema = &state.command->select(*schema);
+        }
+        state.pos_arg_idx = 0;
+        state.vararg_tokens.clear();
+        state.command = nullptr;
+        res = schema->parse_tokens(state);
+    }
+
+    if (state.stats) {
+        state.stats->parses++;
+        state.stats->allocations += state.counted.allocations() - allocations;
+    }
+    return res;
+}
+
+ARGS_INLINE Result Schema::complete(StringView first, ParseState& state) const {
+    StringView word;
+    auto eq = first.find('=');
+    if (eq != StringView::npos) {
+        word = first.substr(eq+1, StringView::npos);
+    } else if (!state.next_token(word)) {
+        word = "";
+    }
+
+    // Words that aren't subcommand names (keys, values, positionals) are
+    // skipped, so no value is converted and nothing runs
+    for (ArgBase* arg : args) {
+        arg->reset();
+    }
+    const Schema* schema = this;
+    StringView token;
+    while (state.next_token(token)) {
+        SubcommandBase* command = schema->find_command(token);
+        if (command) {
+            schema = &command->select(*schema);
+            for (ArgBase* arg : schema->args) {
+                arg->reset();
+            }
+        }
+    }
+
+    if (!no_exit) { schema->print_completions(word); }
+    return Result(Status::COMPLETED, "");
+}
+
+ARGS_INLINE Result Schema::validate_all(const ParseState& state) const {
+    if (first_config_error[0]) {
+        return Result(Status::CONFIG_ERROR, first_config_error);
+    }
+    for (ArgBase* arg : args) {
+        if (!arg->validate()) {
+            if (!silent(state)) {
+                fprintf(stderr, "Could not parse value of argument --%s\n", arg->get_name());
+                print_usage(state);
+            }
+            return Result(Status::ISTREAM_ERROR, arg->get_name());
+        }
+    }
+    for (SubcommandBase* command : commands) {
+        if (command->found()) {
+            return command->built->validate_all(state);
+        }
+    }
+    return Result(Status::SUCCESS, "");
+}
+
+ARGS_INLINE Result Schema::parse_tokens(ParseState& state) const {
+    if (state.stats) {
+        return parse_tokens(state, detail::CountStats(state.stats));
+    }
+    return parse_tokens(state, detail::NoStats());
+}
+
+template<typename Stats>
+Result Schema::parse_tokens(ParseState& state, Stats stats) const {
+    if (first_config_error[0]) {
+        return Result(Status::CONFIG_ERROR, first_config_error);
+    }
+    for (ArgBase* arg : args) {
+        arg->reset();
+    }
+    if (abbreviations) {
+        typename Stats::Timer timer(stats, &ParseStats::registration_ns);
+        build_key_index();
+    }
+
+    detail::ApplySink<Stats> sink(stats);
+    sink.stable = state.source->stable();
+    if (vararg && deferred_varargs && sink.stable) {
+        sink.deferred = &state.vararg_tokens;
+    }
+
+    Result res(Status::SUCCESS, "");
+    {
+        typename Stats::ScanTimer timer(stats);
+        res = scan(state, sink);
+    }
+    if (res) {
+        res = apply_env(state);
+    }
+    return res;
+}
+
+#if !defined(ARGS_NO_THREADS)
+ARGS_INLINE BatchResult Schema::parse_batch(const CommandLine* lines, size_t count, ThreadPool& pool) const {
+    BatchResult result;
+    result.records.resize(count);
+    if (first_config_error[0] || !commands.empty()) {
+        if (!no_exit) {
+            panic("Parser config error: %s", first_config_error[0] ? first_config_error : "parse_batch doesn't support subcommands");
+        }
+        for (BatchRecord& record : result.records) {
+            record.status = Status::CONFIG_ERROR;
+        }
+        return result;
+    }
+    if (abbreviations) {
+        build_key_index();
+    }
+
+    result.stores.resize(pool.size());
+
+    // Every token is at most one value, so with an even split no store
+    // grows more than once or twice
+    size_t tokens = 0;
+    for (size_t i = 0; i < count; i++) {
+        tokens += lines[i].argc > 0 ? (size_t)lines[i].argc - 1 : 0;
+    }
+    for (auto& store : result.stores) {
+        store.reserve(tokens / pool.size() + 1);
+    }
+    std::unique_ptr<ParseState[]> states(new ParseState[pool.size()]);
+
+    pool.parallel_for(count, 64, [&](unsigned worker, size_t begin, size_t end) {
+        ParseState& state = states[worker];
+        state.silent = true;
+        detail::RecordSink sink;
+        sink.out = &result.stores[worker];
+
+        for (size_t i = begin; i < end; i++) {
+            state.argv_source = ArgvSource(lines[i].argc, lines[i].argv);
+            state.reset(state.argv_source);
+            size_t first = sink.out->size();
+            Result res = scan(state, sink);
+
+            BatchRecord& record = result.records[i];
+            record.status = res.status;
+            record.item = res.item;
+            record.store = worker;
+            record.first = (uint32_t)first;
+            record.count = (uint32_t)(sink.out->size() - first);
+        }
+    });
+    return result;
+}
+#endif
+
+template<typename Sink>
+Result Schema::scan(ParseState& state, Sink& sink) const {
+    StringView arg;
+
+    // Collected vararg tokens are converted before the next key or response
+    // file is acted on, so a bad one stops the parse where it would have
+    // converting one at a time.
+    while (state.next_token(arg)) {
+        if (!state.saw_double_dash && arg == "--") {
+            sink.stats.token(TokenKind::DOUBLE_DASH);
+            state.saw_double_dash = true;
+            continue;
+
+        // Long key
+        } else if (!state.saw_double_dash && arg.size() > 2 && arg.starts_with("--")) { 
+            auto res = flush_varargs(state, sink);
+            if (res) {
+                res = parse_long_arg(arg, state, sink);
+            }
+            if (!res) {
+                return res;
+            }
+
+
+        // Response file
+        } else if (!state.saw_double_dash && response_files && arg.size() > 1 && arg[0] == '@') {
+            sink.stats.token(TokenKind::RESPONSE_FILE);
+            auto res = flush_varargs(state, sink);
+            if (res) {
+                res = Sink::interactive ? open_response_file(arg.substr(1), state)
+                                        : Result(Status::RESPONSE_FILE_ERROR, arg.substr(1));
+            }
+            if (!res) {
+                return res;
+            }
+
+         // Short key
+        } else if (!state.saw_double_dash && arg.size() > 1 && arg[0] == '-') {
+            auto res = flush_varargs(state, sink);
+            if (res) {
+                res = parse_short_arg(arg, state, sink); 
+            }
+            if (!res) {
+                return res;
+            }
+
+        // Positional arg
+        } else {
+            if (state.pos_arg_idx < pos_args.size()) {
+                sink.stats.token(TokenKind::POSITIONAL);
+                auto res = parse_positional_arg(arg, state, sink);
+                if (!res) {
+                    return res;
+                }
+            } else if (vararg) {
+                sink.stats.token(TokenKind::VARARG);
+                auto res = parse_vararg(arg, state, sink);
+                if (!res) {
+                    return res;
+                }
+            } else if (!commands.empty()) {
+                // The rest is the subcommand's (see parse)
+                sink.stats.token(TokenKind::COMMAND);
+                SubcommandBase* command = find_command(arg);
+                if (!command) {
+                    return invalid_command(arg, state);
+                }
+                state.command = command;
+                break;
+            } else {
+                // Extranous positional arg
+                sink.stats.token(TokenKind::POSITIONAL);
+                if (!silent(state)) { 
+                    fprintf(stderr, "Too many positional arguments\n");
+                    print_usage(state);
+                }
+                return Result(Status::EXTRA_ARG, "");
+            }
+        }
+    }
+
+    auto res = flush_varargs(state, sink);
+    if (!res) {
+        return res;
+    }
+
+    // The tokens ran out early: whatever follows would judge a truncated
+    // command line
+    if (state.input_failed()) {
+        return input_error(state);
+    }
+
+    if (state.pos_arg_idx < pos_args.size()) {
+        if (!silent(state)) { 
+            fprintf(stderr, "Missing required positional argument(s)\n");
+            print_usage(state);
+        }
+        return Result(Status::MISSING_ARG, "");
+    }
+
+    if (!commands.empty() && !state.command) {
+        if (!silent(state)) { 
+            fprintf(stderr, "Missing command\n");
+            print_usage(state);
+        }
+        return Result(Status::MISSING_ARG, "command");
+    }
+
+    return Result(Status::SUCCESS, "");
+}
+
+template<typename Sink>
+Result Schema::parse_long_arg(StringView arg, ParseState& state, Sink& sink) const {
+    auto eq = arg.find('=');
+    StringView key;
+    StringView value;
+
+    // Get key;
+    if (eq != StringView::npos) {
+        key = arg.substr(2, eq - key.size() - 2);
+    } else {
+        key = arg.substr(2, StringView::npos);
+    }
+    sink.stats.token(eq != StringView::npos ? TokenKind::LONG_EQ : TokenKind::LONG);
+
+    if (key == "help") {
+        if (Sink::interactive && !no_exit) { print_usage(state); }
+        return Result(Status::HELP, "");
+    }
+
+    KVArgBase* kv_arg = nullptr;
+    FlagArg* flag_arg = nullptr;
+    detail::ConvertFn convert = nullptr;
+    {
+        typename Sink::Stats::Timer timer(sink.stats, &ParseStats::lookup_ns);
+        find_long_key(key, kv_arg, flag_arg, &convert, sink.stats);
+    }
+
+    // An empty key (--=x) is a prefix of everything, not an abbreviation
+    if (!kv_arg && !flag_arg && abbreviations && key.size() > 0) {
+        size_t begin, end;
+        {
+            typename Sink::Stats::Timer timer(sink.stats, &ParseStats::lookup_ns);
+            prefix_range(key, begin, end);
+        }
+        // --help is a key too, if not an indexed one
+        bool help = StringView("help").starts_with(key);
+        if (end - begin + help > 1) {
+            if (!silent(state)) {
+                fprintf(stderr, "Long argument key --%s is ambiguous; it could be", key.str().c_str());
+                for (size_t i = begin; i < end; i++) {
+                    fprintf(stderr, "%s --%s", i == begin ? "" : ",", index_key(key_index[i]).str().c_str());
+                }
+                fprintf(stderr, "%s\n", help ? ", --help" : "");
+                print_usage(state);
+            }
+            return Result(Status::AMBIGUOUS_KEY, key);
+        }
+        if (help) {
+            if (Sink::interactive && !no_exit) { print_usage(state); }
+            return Result(Status::HELP, "");
+        }
+        if (end - begin == 1) {
+            kv_arg = key_index[begin].kv;
+            flag_arg = key_index[begin].flag;
+            convert = kv_arg ? kv_arg->convert : nullptr;
+        }
+    }
+
+    if (!kv_arg) {
+        if (!flag_arg) {
+            Result res(Status::INVALID_KEY, key);
+            // Only on this path, and never from a batch's threads
+            if (Sink::interactive) {
+                res.suggestions = state.suggestions;
+                res.suggestion_count = (uint32_t)suggest(key, state.suggestions, Result::max_suggestions);
+            }
+            if (!silent(state)) { 
+                fprintf(stderr, "Long argument key --%s invalid", key.str().c_str());
+                for (uint32_t i = 0; i < res.suggestion_count; i++) {
+                    fprintf(stderr, "%s --%s", i == 0 ? "; did you mean" : ",", res.suggestions[i].str().c_str());
+                }
+                if (res.suggestion_count) {
+                    fprintf(stderr, "?\nRun with --help for usage\n");
+                } else {
+                    fprintf(stderr, "\n");
+                    print_usage(state);
+                }
+            }
+            return res;
+        }
+
+        sink.flag(flag_arg);
+        return Result(Status::SUCCESS, "");   
+    }
+
+
+    // Get value
+    if (eq != StringView::npos) {
+        value = arg.substr(eq+1, StringView::npos);
+    } else {
+        if (!state.next_token(value)) {
+            if (state.input_failed()) {
+                return input_error(state);
+            }
+            if (!silent(state)) { 
+                fprintf(stderr, "Long argument key --%s needs value\n", kv_arg->get_key());
+                print_usage(state);
+            }
+            return Result(Status::MISSING_VALUE, kv_arg->get_key());
+        }
+        sink.stats.token(TokenKind::VALUE);
+    }
+
+    bool good = sink.kv(kv_arg, value, convert);
+    if (!good) {
+        if (!silent(state)) { 
+            fprintf(stderr, "Could not parse value of argument --%s\n", kv_arg->get_key());
+            print_usage(state);
+        }
+        return Result(Status::ISTREAM_ERROR, kv_arg->get_key());
+    }
+    
+
+    return Result(Status::SUCCESS, "");
+}
+
+template<typename Sink>
+Result Schema::parse_short_arg(StringView arg, ParseState& state, Sink& sink) const {
+    char key = arg[1];
+    StringView key_item = arg.substr(1, 1);
+    ShortKey entry = short_keys[(uint8_t)key];
+    sink.stats.token(TokenKind::SHORT);
+    sink.stats.lookup();
+    sink.stats.probe();
+
+    if (entry.kind() == ShortKey::HELP) {
+        if (Sink::interactive && !no_exit) { print_usage(state); }
+        return Result(Status::HELP, "");
+    }
+
+    if (entry.kind() == ShortKey::INVALID) {
+        if (!silent(state)) { 
+            fprintf(stderr, "Short argument key -%c invalid\n", key);
+            print_usage(state);
+        }
+        return Result(Status::INVALID_KEY, key_item);
+    }
+
+    if (entry.kind() == ShortKey::FLAG) {
+        if (arg.size() > 2) {
+            if (!silent(state)) { 
+                fprintf(stderr, "Flag -%c doesn't take a value\n", key);
+                print_usage(state);
+            }
+            return Result(Status::EXTRA_VALUE, key_item);
+        }
+
+        sink.flag(entry.flag());
+        return Result(Status::SUCCESS, "");   
+    }
+
+
+    StringView value;
+    if (arg.size() > 2) {
+        value = arg.substr(2, StringView::npos);
+    } else {
+        if (!state.next_token(value)) {
+            if (state.input_failed()) {
+                return input_error(state);
+            }
+            if (!silent(state)) { 
+                fprintf(stderr, "Short argument key -%c needs value\n", key);
+                print_usage(state);
+            }
+            return Result(Status::MISSING_VALUE, entry.kv()->get_short_key());
+        }
+        sink.stats.token(TokenKind::VALUE);
+    }
+
+
+    bool good = sink.kv(entry.kv(), value, entry.kv()->convert);
+    if (!good) {
+        if (!silent(state)) { 
+            fprintf(stderr, "Could not parse value of argument -%c\n", key);
+            print_usage(state);
+        }
+        return Result(Status::ISTREAM_ERROR, entry.kv()->get_short_key());
+    }
+
+    return Result(Status::SUCCESS, ""); 
+}
+
+template<typename Sink>
+Result Schema::parse_positional_arg(StringView arg, ParseState& state, Sink& sink) const {
+    assert(state.pos_arg_idx < pos_args.size());
+    auto& pos_arg = pos_args.at(state.pos_arg_idx);
+    bool good = sink.pos(pos_arg, arg, pos_arg->convert);
+    if (!good) {
+        if (!silent(state)) { 
+            fprintf(stderr, "Could not parse positional argument \"%s\"\n", arg.str().c_str());
+            print_usage(state);
+        }
+        return Result(Status::ISTREAM_ERROR, pos_arg->get_name());
+    }
+    state.pos_arg_idx++;
+    return Result(Status::SUCCESS, "");         
+}
+
+template<typename Sink>
+Result Schema::parse_vararg(StringView arg, ParseState& state, Sink& sink) const {
+    if (!sink.var(vararg, arg)) {
+        return vararg_error(arg, state);
+    }
+    return Result(Status::SUCCESS, "");
+}
+
+template<typename Sink>
+Result Schema::flush_varargs(ParseState& state, Sink& sink) const {
+    StringView bad;
+    if (!sink.flush(vararg, vararg_pool, bad)) {
+        return vararg_error(bad, state);
+    }
+    return Result(Status::SUCCESS, "");
+}
+
+ARGS_INLINE Result Schema::vararg_error(StringView arg, ParseState& state) const {
+    if (!silent(state)) { 
+        fprintf(stderr, "Could not parse vararg \"%s\"\n", arg.str().c_str());
+        print_usage(state);
+    }
+    return Result(Status::ISTREAM_ERROR, vararg->get_name());
+}
+
+ARGS_INLINE Result Schema::open_response_file(StringView path, ParseState& state) const {
+#if defined(ARGS_POSIX)
+    ParseState::ResponseFile file;
+    struct stat st;
+    const char* err = detail::map_file(path, PROT_READ | PROT_WRITE, file.base, file.size, st);
+
+    for (size_t i = 0; !err && i < state.open_files.size(); i++) {
+        auto& active = state.files[state.open_files[i]];
+        if (active.dev == st.st_dev && active.ino == st.st_ino) {
+            err = "includes itself";
+        }
+    }
+
+    if (err) {
+        if (file.base) {
+            munmap(file.base, file.size);
+        }
+        if (!silent(state)) {
+            fprintf(stderr, "Response file %s: %s\n", path.str().c_str(), err);
+            print_usage(state);
+        }
+        return Result(Status::RESPONSE_FILE_ERROR, path);
+    }
+
+    file.path = path;
+    file.cur = file.base;
+    file.end = file.base + file.size;
+    file.dev = st.st_dev;
+    file.ino = st.st_ino;
+    state.files.push_back(file);
+    state.open_files.push_back(state.files.size() - 1);
+    return Result(Status::SUCCESS, "");
+#else
+    if (!silent(state)) {
+        fprintf(stderr, "Response files aren't supported on this platform\n");
+    }
+    return Result(Status::RESPONSE_FILE_ERROR, path);
+#endif
+}
+
+ARGS_INLINE void Schema::find_long_key(StringView key, KVArgBase*& kv_arg, FlagArg*& flag_arg, detail::ConvertFn* convert) const {
+    find_long_key(key, kv_arg, flag_arg, convert, detail::NoStats());
+}
+
+template<typename Stats>
+void Schema::find_long_key(StringView key, KVArgBase*& kv_arg, FlagArg*& flag_arg, detail::ConvertFn* convert, Stats stats) const {
+    stats.lookup();
+    if (key_table.size) {
+        stats.probe();
+        long idx = key_table.find(key);
+        if (idx >= 0) {
+            kv_arg = key_table_args[idx].kv;
+            flag_arg = key_table_args[idx].flag;
+            if (convert && kv_arg) { *convert = kv_arg->convert; }
+        }
+        return;
+    }
+
+    long entry = find_registered(key, stats);
+    if (entry < 0) {
+        return;
+    }
+    const RegistryTarget& target = reg_targets[entry];
+    if (reg_kinds[entry] == ShortKey::KV) {
+        kv_arg = static_cast<KVArgBase*>(target.arg);
+        if (convert) { *convert = target.convert; }
+    } else {
+        flag_arg = static_cast<FlagArg*>(target.arg);
+    }
+}
+
+template<typename Stats>
+long Schema::find_registered(StringView key, Stats stats) const {
+    if (reg_slots.empty()) {
+        return -1;
+    }
+    uint64_t h = detail::hash_key(key.data(), key.size());
+    uint64_t tag = h >> 32;
+    size_t mask = reg_slots.size() - 1;
+    for (size_t i = (size_t)h & mask; ; i = (i + 1) & mask) {
+        stats.probe();
+        uint64_t slot = reg_slots[i];
+        if (!slot) {
+            break;
+        }
+        if ((slot >> 32) != tag) {
+            continue;
+        }
+        uint32_t entry = (uint32_t)slot - 1;
+        if (reg_lens[entry] == key.size() &&
+            memcmp(reg_bytes.data() + reg_offsets[entry], key.data(), key.size()) == 0) {
+            return (long)entry;
+        }
+    }
+    return -1;
+}
+
+ARGS_INLINE void Schema::register_key(StringView key, ShortKey::Kind kind, ArgBase* arg) {
+    reg_offsets.push_back((uint32_t)reg_bytes.size());
+    reg_lens.push_back((uint32_t)key.size());
+    reg_bytes.insert(reg_bytes.end(), key.data(), key.data() + key.size());
+    reg_kinds.push_back((uint8_t)kind);
+    RegistryTarget target = {arg->convert, arg};
+    reg_targets.push_back(target);
+
+    size_t n = reg_lens.size();
+    if (2 * n > reg_slots.size()) {
+        // Rehash at half full, to a power of two at most a quarter full
+        size_t size = 16;
+        while (size < 4 * n) { size *= 2; }
+        reg_slots.assign(size, 0);
+        for (size_t entry = 0; entry < n; entry++) {
+            insert_registered((uint32_t)entry);
+        }
+    } else {
+        insert_registered((uint32_t)(n - 1));
+    }
+}
+
+ARGS_INLINE void Schema::insert_registered(uint32_t entry) {
+    uint64_t h = detail::hash_key(reg_bytes.data() + reg_offsets[entry], reg_lens[entry]);
+    size_t mask = reg_slots.size() - 1;
+    size_t i = (size_t)h & mask;
+    while (reg_slots[i]) {
+        i = (i + 1) & mask;
+    }
+    reg_slots[i] = (h >> 32 << 32) | (entry + 1);
+}
+
+ARGS_INLINE StringView Schema::usage_text() const {
+    if (usage.empty()) {
+        render_usage();
+    }
+    return StringView::from_range(usage.data(), usage.data() + usage.size());
+}
+
+ARGS_INLINE size_t Schema::complete(StringView prefix, StringView* out, size_t max_out) const {
+    build_key_index();
+    size_t begin, end;
+    prefix_range(prefix, begin, end);
+    for (size_t i = begin; i < end && i - begin < max_out; i++) {
+        out[i - begin] = index_key(key_index[i]);
+    }
+    return end - begin;
+}
+
+ARGS_INLINE size_t Schema::suggest(StringView key, StringView* out, size_t max_out) const {
+    if (key.size() > detail::EditDistance::max_pattern || max_out == 0) {
+        return 0;
+    }
+    build_key_index();
+
+    detail::Nearest nearest(key, out, max_out < Result::max_suggestions ? max_out : Result::max_suggestions);
+    for (auto& entry : key_index) {
+        nearest.consider(index_key(entry));
+    }
+    nearest.consider("help");
+    return nearest.count();
+}
+
+ARGS_INLINE void Schema::print_completions(StringView word) const {
+    std::string text;
+    if (word.size() == 0 || word[0] != '-') {
+        for (SubcommandBase* command : commands) {
+            if (StringView(command->get_name()).starts_with(word)) {
+                text += command->get_name();
+                text += "\n";
+            }
+        }
+    }
+
+    StringView prefix;
+    if (word.size() == 0 || word == "-") {
+        prefix = "";
+    } else if (word.starts_with("--")) {
+        prefix = word.substr(2);
+    } else {
+        detail::write_all(stdout, text.data(), text.size());
+        return;
+    }
+
+    build_key_index();
+    size_t begin, end;
+    prefix_range(prefix, begin, end);
+
+    for (size_t i = begin; i < end; i++) {
+        text += "--";
+        text += index_key(key_index[i]).str();
+        text += "\n";
+    }
+    if (StringView("help").starts_with(prefix)) {
+        text += "--help\n";
+    }
+    detail::write_all(stdout, text.data(), text.size());
+}
+
+ARGS_INLINE std::string Schema::completion_script(Shell shell) const {
+    std::string app = app_name;
+    std::string fn = "_args_complete_";
+    for (char c : app) {
+        bool ident = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        fn += ident ? c : '_';
+    }
+
+    std::string script;
+    if (shell == Shell::BASH) {
+        script += "# bash completion for " + app + "\n";
+        script += fn + "() {\n";
+        script += "    local cur=\"${COMP_WORDS[COMP_CWORD]}\"\n";
+        script += "    COMPREPLY=($(\"${COMP_WORDS[0]}\" --args-complete \"$cur\" \"${COMP_WORDS[@]:1:COMP_CWORD-1}\" 2>/dev/null))\n";
+        script += "}\n";
+        script += "complete -o default -F " + fn + " " + app + "\n";
+    } else {
+        script += "#compdef " + app + "\n";
+        script += fn + "() {\n";
+        script += "    local -a candidates\n";
+        script += "    candidates=(${(f)\"$(\"${words[1]}\" --args-complete \"${words[CURRENT]}\" \"${(@)words[2,CURRENT-1]}\" 2>/dev/null)\"})\n";
+        script += "    if (( ${#candidates} )); then\n";
+        script += "        compadd -a candidates\n";
+        script += "    else\n";
+        script += "        _files\n";
+        script += "    fi\n";
+        script += "}\n";
+        script += "compdef " + fn + " " + app + "\n";
+    }
+    return script;
+}
+
+ARGS_INLINE Result Schema::apply_config_file(ParseState& state) const {
+    StringView path = state.config_path;
+#if defined(ARGS_POSIX)
+    struct stat st;
+    const char* err = detail::map_file(path, PROT_READ, state.config_base, state.config_size, st);
+    if (err) {
+        if (!silent(state)) {
+            fprintf(stderr, "Config file %s: %s\n", state.config_path, err);
+            print_usage(state);
+        }
+        return Result(Status::CONFIG_FILE_ERROR, path);
+    }
+
+    state.given.assign(args.size(), 0);
+    for (ArgBase* arg : args) {
+        state.given[arg->get_id()] = arg->found();
+    }
+
+    const char* p = state.config_base;
+    const char* end = p + state.config_size;
+    for (uint32_t line = 1; p < end; line++) {
+        const char* nl = detail::find_char(p, end, '\n');
+        StringView text = detail::trim(StringView::from_range(p, nl));
+        p = nl == end ? end : nl + 1;
+        if (text.size() == 0 || text[0] == '#') {
+            continue;
+        }
+
+        const char* text_end = text.data() + text.size();
+        const char* eq = detail::find_char(text.data(), text_end, '=');
+        StringView key = detail::trim(StringView::from_range(text.data(), eq));
+        bool has_value = eq != text_end;
+        StringView value = has_value ? detail::trim(StringView::from_range(eq + 1, text_end)) : StringView();
+
+        KVArgBase* kv_arg = nullptr;
+        FlagArg* flag_arg = nullptr;
+        find_long_key(key, kv_arg, flag_arg);
+
+        const char* problem = nullptr;
+        Status status = Status::SUCCESS;
+        if (!kv_arg && !flag_arg) {
+            problem = "invalid key";
+            status = Status::INVALID_KEY;
+        } else if (kv_arg && !has_value) {
+            problem = "needs a value:";
+            status = Status::MISSING_VALUE;
+        } else if (kv_arg && !state.given[kv_arg->get_id()]) {
+            if (!kv_arg->parse(value)) {
+                problem = "could not parse value of";
+                status = Status::ISTREAM_ERROR;
+            }
+        } else if (flag_arg && !state.given[flag_arg->get_id()]) {
+            if (!has_value) {
+                flag_arg->parse();
+            } else if (!flag_arg->parse_env(value)) {
+                problem = "could not parse value of";
+                status = Status::ISTREAM_ERROR;
+            }
+        }
+
+        if (problem) {
+            if (!silent(state)) {
+                fprintf(stderr, "%s:%u: %s %s\n", state.config_path, line, problem, key.str().c_str());
+                print_usage(state);
+            }
+            Result res(status, key);
+            res.line = line;
+            return res;
+        }
+    }
+    return Result(Status::SUCCESS, "");
+#else
+    if (!silent(state)) {
+        fprintf(stderr, "Config files aren't supported on this platform\n");
+    }
+    return Result(Status::CONFIG_FILE_ERROR, path);
+#endif
+}
+
+ARGS_INLINE Result Schema::apply_env(ParseState& state) const {
+    // environ is read now, not when the state was made: setenv may have
+    // changed it, or moved it, since
+    const char* const* envp = state.envp;
+#if defined(ARGS_POSIX)
+    if (!envp) {
+        envp = environ;
+    }
+#endif
+
+    bool indexed = false;
+    for (ArgBase* arg : args) {
+        if (!arg->get_env() || arg->found()) {
+            continue;
+        }
+
+        StringView value;
+        bool set;
+        if (envp) {
+            if (!indexed) {
+                state.env_index.build(envp);
+                indexed = true;
+            }
+            set = state.env_index.find(arg->get_env(), value);
+        } else {
+            const char* v = getenv(arg->get_env());
+            set = v != nullptr;
+            value = v ? v : "";
+        }
+
+        if (set && !arg->parse_env(value)) {
+            if (!silent(state)) {
+                fprintf(stderr, "Could not parse value of environment variable %s for %s\n", arg->get_env(), arg->get_name());
+                print_usage(state);
+            }
+            return Result(Status::ISTREAM_ERROR, arg->get_env());
+        }
+    }
+    return Result(Status::SUCCESS, "");
+}
+
+ARGS_INLINE void Schema::register_arg(ArgBase* arg) {
+    arg->id = (uint32_t)args.size();
+    args.push_back(arg);
+    usage.clear();
+    key_index_ready = false;
+}
+
+ARGS_INLINE void Schema::insert_command(SubcommandBase* command) {
+    StringView name = command->get_name();
+    size_t mask = command_slots.size() - 1;
+    size_t i = (size_t)detail::hash_key(name.data(), name.size()) & mask;
+    while (command_slots[i].command) {
+        i = (i + 1) & mask;
+    }
+    command_slots[i].name = name.data();
+    command_slots[i].size = (uint32_t)name.size();
+    command_slots[i].command = command;
+}
+
+ARGS_INLINE SubcommandBase* Schema::find_command(StringView name) const {
+    if (command_slots.empty()) {
+        return nullptr;
+    }
+    size_t mask = command_slots.size() - 1;
+    size_t i = (size_t)detail::hash_key(name.data(), name.size()) & mask;
+    for (; command_slots[i].command; i = (i + 1) & mask) {
+        const CommandSlot& slot = command_slots[i];
+        if (slot.size == name.size() && memcmp(slot.name, name.data(), name.size()) == 0) {
+            return slot.command;
+        }
+    }
+    return nullptr;
+}
+
+ARGS_INLINE Result Schema::invalid_command(StringView name, ParseState& state) const {
+    Result res(Status::INVALID_COMMAND, name);
+    detail::Nearest nearest(name, state.suggestions, Result::max_suggestions);
+    for (SubcommandBase* command : commands) {
+        nearest.consider(command->get_name());
+    }
+    res.suggestions = state.suggestions;
+    res.suggestion_count = (uint32_t)nearest.count();
+
+    if (!silent(state)) {
+        fprintf(stderr, "Unknown command %s", name.str().c_str());
+        for (uint32_t i = 0; i < res.suggestion_count; i++) {
+            fprintf(stderr, "%s %s", i == 0 ? "; did you mean" : ",", res.suggestions[i].str().c_str());
+        }
+        if (res.suggestion_count) {
+            fprintf(stderr, "?\nRun with --help for usage\n");
+        } else {
+            fprintf(stderr, "\n");
+            print_usage(state);
+        }
+    }
+    return res;
+}
+
+ARGS_INLINE Result Schema::input_error(ParseState& state) const {
+    if (state.bad_file.data()) {
+        if (!silent(state)) {
+            fprintf(stderr, "Response file %s: unterminated quote\n", state.bad_file.str().c_str());
+            print_usage(state);
+        }
+        return Result(Status::RESPONSE_FILE_ERROR, state.bad_file);
+    }
+    if (!silent(state)) {
+        fprintf(stderr, "Could not read arguments: read error or token too long\n");
+    }
+    return Result(Status::SOURCE_ERROR, "");
+}
+
+ARGS_INLINE void Schema::build_key_index() const {
+    if (key_index_ready) {
+        return;
+    }
+    key_index.clear();
+    key_bytes.clear();
+
+    for (auto& p : kv_keys) {
+        KeyIndexEntry entry = {0, (uint32_t)p.first.size(), p.second, nullptr};
+        key_index.push_back(entry);
+    }
+    for (auto& p : flag_keys) {
+        KeyIndexEntry entry = {0, (uint32_t)p.first.size(), nullptr, p.second};
+        key_index.push_back(entry);
+    }
+    auto registered = [](const KeyIndexEntry& e) {
+        return StringView(e.kv ? e.kv->get_key() : e.flag->get_key());
+    };
+    std::sort(key_index.begin(), key_index.end(), [&](const KeyIndexEntry& a, const KeyIndexEntry& b) {
+        return key_less(registered(a), registered(b));
+    });
+
+    for (auto& entry : key_index) {
+        StringView k = registered(entry);
+        entry.offset = (uint32_t)key_bytes.size();
+        key_bytes.insert(key_bytes.end(), k.data(), k.data() + k.size());
+    }
+    key_index_ready = true;
+}
+
+ARGS_INLINE void Schema::prefix_range(StringView prefix, size_t& begin, size_t& end) const {
+    // Compares an entry's first prefix.size() bytes with prefix
+    auto compare = [&](const KeyIndexEntry& entry) {
+        StringView k = index_key(entry);
+        size_t n = std::min(k.size(), prefix.size());
+        int c = n ? memcmp(k.data(), prefix.data(), n) : 0;
+        return c != 0 ? c : (k.size() < prefix.size() ? -1 : 0);
+    };
+    const KeyIndexEntry* first = key_index.data();
+    const KeyIndexEntry* last = first + key_index.size();
+    const KeyIndexEntry* lo = std::partition_point(first, last,
+        [&](const KeyIndexEntry& e) { return compare(e) < 0; });
+    const KeyIndexEntry* hi = std::partition_point(lo, last,
+        [&](const KeyIndexEntry& e) { return compare(e) == 0; });
+    begin = (size_t)(lo - first);
+    end = (size_t)(hi - first);
+}
+
+ARGS_INLINE void Schema::render_usage() const {
+    usage.clear();
+
+    // Left column width, over every section
+    size_t width = StringView("--help, -h").size();
+    for (auto& config : pos_args) {
+        width = std::max(width, StringView(config->get_name()).size());
+    }
+    if (vararg) {
+        width = std::max(width, StringView(vararg->get_name()).size());
+    }
+    for (SubcommandBase* command : commands) {
+        width = std::max(width, StringView(command->get_name()).size());
+    }
+    for (auto& p : kv_keys) {
+        size_t short_size = *p.second->get_short_key() ? 4 : 0;
+        width = std::max(width, 2 + p.first.size() + short_size + 6);
+    }
+    for (auto& p : flag_keys) {
+        size_t short_size = *p.second->get_short_key() ? 4 : 0;
+        width = std::max(width, 2 + p.first.size() + short_size);
+    }
+    width += 2;
+
+    append("USAGE:\n\t");
+    append(app_name);
+    append(": ");
+    if (kv_keys.size() > 0) {
+        append(" [OPTIONS] ");
+    }
+    append("[FLAGS] ");
+    for (auto& config : pos_args) {
+        append("<");
+        append(config->get_name());
+        append("> ");
+    }
+    if (vararg) {
+        append("[");
+        append(vararg->get_name());
+        append("]...");
+    }
+    if (!commands.empty()) {
+        append("<command> ...");
+    }
+    append("\n");
+
+    size_t row;
+    if (pos_args.size() > 0 || vararg) {
+        append("\nARGS:\n");
+        for (auto& config : pos_args) {
+            append("\t");
+            row = usage.size();
+            append(config->get_name());
+            end_row(row, config->get_desc(), width);
+        }
+        if (vararg) {
+            append("\t");
+            row = usage.size();
+            append(vararg->get_name());
+            end_row(row, vararg->get_desc(), width);
+        }
+    }
+
+    if (!commands.empty()) {
+        append("\nCOMMANDS:\n");
+        for (SubcommandBase* command : commands) {
+            append("\t");
+            row = usage.size();
+            append(command->get_name());
+            end_row(row, command->get_desc(), width);
+        }
+    }
+
+    if (kv_keys.size() > 0) {
+        append("\nOPTIONS:\n");
+        for (auto& p : kv_keys) {
+            append("\t");
+            row = usage.size();
+            append("--");
+            append(p.first);
+            if (*p.second->get_short_key() != '\0') {
+                append(", -");
+                append(p.second->get_short_key());
+            }
+            append(" <val>");
+            end_row(row, p.second->get_desc(), width);
+        }
+    }
+
+    append("\nFLAGS:\n");
+    for (auto& p : flag_keys) {
+        append("\t");
+        row = usage.size();
+        append("--");
+        append(p.first);
+        if (*p.second->get_short_key() != '\0') {
+            append(", -");
+            append(p.second->get_short_key());
+        }
+        end_row(row, p.second->get_desc(), width);
+    }
+    append("\t");
+    row = usage.size();
+    append("--help, -h");
+    end_row(row, "Print help message", width);
+}
+
+ARGS_INLINE long Schema::table_index(StringView k, const char* name) {
+    long idx = key_table.find(k);
+    if (idx < 0) {
+        config_error("Parser config error: config %s's key isn't in the key table", name);
+    }
+    return idx;
+}
+
+ARGS_INLINE bool Schema::check_short_key(StringView short_k, const char* name) {
+    if (short_k == "") {
+        return true;
+    }
+    if (short_k.size() > 1) {
+        config_error("Parser config error: config %s's short key %s is %zu characters; A short key must be zero characters (no short key) or one character", name, short_k.str().c_str(), short_k.size());
+        return false;
+    }
+    char c = short_k[0];
+    if (short_keys[(uint8_t)c].kind() != ShortKey::INVALID) {
+        config_error("Parser config error: config %s's short key %c is a duplicate", name, c);
+        return false;
+    }
+    return true;
+}
+
+ARGS_INLINE void Schema::config_error(const char* fmt, ...) {
+    char message[sizeof(first_config_error)];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+    if (!no_exit) {
+        panic("%s", message);
+    }
+    if (!first_config_error[0]) {
+        memcpy(first_config_error, message, sizeof(message));
+    }
+}
+
+#endif // !defined(ARGS_DECLARE_ONLY)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Struct schemas
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail {
+
+enum class FieldKind { KV, FLAG, POS };
+
+// What a StructSchema needs to know about a field, besides how to convert it
+struct FieldInfo {
+    FieldKind kind = FieldKind::KV;
+    const char* key = "";
+    size_t len = 0;
+    const char* short_key = "";
+    const char* desc = "";
+};
+
+template<typename S, typename T>
+struct KVField {
+    const char* key;
+    const char* short_key;
+    T S::* member;
+    const char* desc;
+
+    ARGS_CONSTEXPR14 FieldInfo info() const {
+        FieldInfo i;
+        i.kind = FieldKind::KV;
+        i.key = key;
+        i.len = const_strlen(key);
+        i.short_key = short_key;
+        i.desc = desc;
+        return i;
+    }
+
+    bool apply(S& out, StringView value) const { return Converter<T>::parse(value, out.*member); }
+};
+
+template<typename S>
+struct FlagField {
+    const char* key;
+    const char* short_key;
+    bool S::* member;
+    const char* desc;
+
+    ARGS_CONSTEXPR14 FieldInfo info() const {
+        FieldInfo i;
+        i.kind = FieldKind::FLAG;
+        i.key = key;
+        i.len = const_strlen(key);
+        i.short_key = short_key;
+        i.desc = desc;
+        return i;
+    }
+
+    bool apply(S& out, StringView) const {
+        out.*member = true;
+        return true;
+    }
+};
+
+template<typename S, typename T>
+struct PosField {
+    const char* name;
+    T S::* member;
+    const char* desc;
+
+    ARGS_CONSTEXPR14 FieldInfo info() const {
+        FieldInfo i;
+        i.kind = FieldKind::POS;
+        i.key = name;
+        i.len = const_strlen(name);
+        i.desc = desc;
+        return i;
+    }
+
+    bool apply(S& out, StringView value) const { return Converter<T>::parse(value, out.*member); }
+};
+
+// The fields, stored by value with their exact types. apply(i, ...) unrolls
+// into a chain of compares on i that the compiler turns into a jump table,
+// with each field's conversion inlined into its case.
+template<typename S, typename... Fields>
+struct FieldList {
+    ARGS_CONSTEXPR14 void describe(FieldInfo*) const {}
+    bool apply(size_t, S&, StringView) const { return false; }
+};
+
+template<typename S, typename F, typename... Rest>
+struct FieldList<S, F, Rest...> {
+    F head;
+    FieldList<S, Rest...> tail;
+
+    constexpr explicit FieldList(F _head, Rest... rest) : head(_head), tail(rest...) {}
+
+    ARGS_CONSTEXPR14 void describe(FieldInfo* out) const {
+        out[0] = head.info();
+        tail.describe(out + 1);
+    }
+
+    bool apply(size_t i, S& out, StringView value) const {
+        return i == 0 ? head.apply(out, value) : tail.apply(i - 1, out, value);
+    }
+};
+
+ARGS_CONSTEXPR14 inline bool same_str(const char* a, const char* b) {
+    size_t i = 0;
+    while (a[i] && a[i] == b[i]) { i++; }
+    return a[i] == b[i];
+}
+
+} // namespace detail
+
+
+// A long-keyed value, flag or positional, bound to a member of S
+template<typename S, typename T>
+constexpr detail::KVField<S, T> kv_field(const char* key, const char* short_key, T S::* member, const char* desc) {
+    return detail::KVField<S, T>{key, short_key, member, desc};
+}
+
+template<typename S>
+constexpr detail::FlagField<S> flag_field(const char* key, const char* short_key, bool S::* member, const char* desc) {
+    return detail::FlagField<S>{key, short_key, member, desc};
+}
+
+template<typename S, typename T>
+constexpr detail::PosField<S, T> pos_field(const char* name, T S::* member, const char* desc) {
+    return detail::PosField<S, T>{name, member, desc};
+}
+
+
+// A schema fixed at compile time that parses straight into the members of
+// a plain struct: no registration, no heap, and no virtual calls, since each
+// field's type is part of the schema's. Keys are matched by length and then
+// bytes, the way a hand-written strcmp loop would. Under C++14 and later it
+// can be built at compile time, which lets its config be checked with
+// static_assert (otherwise parse() panics on a bad config, as Schema does):
+//
+//     struct Opts {
+//         int threads = 1;
+//         bool verbose = false;
+//         std::string input;
+//     };
+//
+//     static constexpr auto opts_schema = args::make_struct_schema<Opts>("tool",
+//         args::kv_field("threads", "t", &Opts::threads, "Worker threads"),
+//         args::flag_field("verbose", "v", &Opts::verbose, "Chatty"),
+//         args::pos_field("input", &Opts::input, "Input file"));
+//     static_assert(opts_schema.valid(), "bad opts_schema");
+//
+//     Opts opts;
+//     if (!opts_schema.parse(argc, argv, opts)) { return 1; }
+//
+// Fields the command line doesn't give keep the value they had. Positionals
+// are required.
+template<typename S, typename... Fields>
+class StructSchema {
+    static const size_t N = sizeof...(Fields);
+
+public:
+    ARGS_CONSTEXPR14 explicit StructSchema(const char* _app_name, Fields... fields)
+    : app_name(_app_name), list(fields...), info{}, pos_idx{}, short_idx{} {
+        list.describe(info);
+        err = check();
+    }
+
+    // False if two fields share a key, a key is empty or reserved ("help",
+    // "h"), or a short key isn't one character
+    constexpr bool valid() const { return err == nullptr; }
+
+    // What's wrong with the config, or null
+    constexpr const char* error() const { return err; }
+
+    // Skips argv[0], which must outlive the values read from argv.
+    Result parse(int argc, const char** argv, S& out, bool silent=false) const {
+        if (err) {
+            panic("Parser config error: %s", err);
+        }
+
+        uint32_t pos = 0;
+        bool saw_double_dash = false;
+        for (int i = 1; i < argc; i++) {
+            StringView arg(argv[i]);
+
+            if (!saw_double_dash && arg == "--") {
+                saw_double_dash = true;
+
+            } else if (!saw_double_dash && arg.size() > 2 && arg[0] == '-' && arg[1] == '-') {
+                size_t eq = arg.find('=');
+                StringView key = arg.substr(2, eq == StringView::npos ? StringView::npos : eq - 2);
+                if (key == "help") {
+                    if (!silent) { print_usage(); }
+                    return Result(Status::HELP, "");
+                }
+
+                size_t f = find_long_key(key);
+                if (f == N) {
+                    if (!silent) {
+                        fprintf(stderr, "Long argument key --%s invalid\n", key.str().c_str());
+                        print_usage();
+                    }
+                    return Result(Status::INVALID_KEY, key);
+                }
+
+                StringView value;
+                if (info[f].kind == detail::FieldKind::KV) {
+                    if (eq != StringView::npos) {
+                        value = arg.substr(eq + 1);
+                    } else if (i + 1 < argc) {
+                        value = argv[++i];
+                    } else {
+                        if (!silent) {
+                            fprintf(stderr, "Long argument key --%s needs value\n", info[f].key);
+                            print_usage();
+                        }
+                        return Result(Status::MISSING_VALUE, info[f].key);
+                    }
+                }
+                if (!list.apply(f, out, value)) {
+                    if (!silent) {
+                        fprintf(stderr, "Could not parse value of argument --%s\n", info[f].key);
+                        print_usage();
+                    }
+                    return Result(Status::ISTREAM_ERROR, info[f].key);
+                }
+
+            } else if (!saw_double_dash && arg.size() > 1 && arg[0] == '-') {
+                char key = arg[1];
+                StringView key_item = arg.substr(1, 1);
+                if (key == 'h') {
+                    if (!silent) { print_usage(); }
+                    return Result(Status::HELP, "");
+                }
+
+                size_t f = short_idx[(uint8_t)key];
+                if (f == 0) {
+                    if (!silent) {
+                        fprintf(stderr, "Short argument key -%c invalid\n", key);
+                        print_usage();
+                    }
+                    return Result(Status::INVALID_KEY, key_item);
+                }
+                f--;
+
+                StringView value;
+                if (info[f].kind == detail::FieldKind::FLAG) {
+                    if (arg.size() > 2) {
+                        if (!silent) {
+                            fprintf(stderr, "Flag -%c doesn't take a value\n", key);
+                            print_usage();
+                        }
+                        return Result(Status::EXTRA_VALUE, key_item);
+                    }
+                } else if (arg.size() > 2) {
+                    value = arg.substr(2);
+                } else if (i + 1 < argc) {
+                    value = argv[++i];
+                } else {
+                    if (!silent) {
+                        fprintf(stderr, "Short argument key -%c needs value\n", key);
+                        print_usage();
+                    }
+                    return Result(Status::MISSING_VALUE, info[f].short_key);
+                }
+                if (!list.apply(f, out, value)) {
+                    if (!silent) {
+                        fprintf(stderr, "Could not parse value of argument -%c\n", key);
+                        print_usage();
+                    }
+                    return Result(Status::ISTREAM_ERROR, info[f].short_key);
+                }
+
+            } else {
+                if (pos == num_pos) {
+                    if (!silent) {
+                        fprintf(stderr, "Too many positional arguments\n");
+                        print_usage();
+                    }
+                    return Result(Status::EXTRA_ARG, "");
+                }
+                size_t f = pos_idx[pos];
+                if (!list.apply(f, out, arg)) {
+                    if (!silent) {
+                        fprintf(stderr, "Could not parse positional argument \"%s\"\n", arg.str().c_str());
+                        print_usage();
+                    }
+                    return Result(Status::ISTREAM_ERROR, info[f].key);
+                }
+                pos++;
+            }
+        }
+
+        if (pos < num_pos) {
+            if (!silent) {
+                fprintf(stderr, "Missing required positional argument(s)\n");
+                print_usage();
+            }
+            return Result(Status::MISSING_ARG, "");
+        }
+        return Result(Status::SUCCESS, "");
+    }
+
+    // Usage in Schema's format. Rendered each time: it's only for errors and
+    // --help.
+    void print_usage() const {
+        std::string text = "USAGE:\n\t";
+        text += app_name;
+        text += ": ";
+        bool any_kv = false;
+        size_t width = StringView("--help, -h").size();
+        for (size_t i = 0; i < N; i++) {
+            size_t short_size = *info[i].short_key ? 4 : 0;
+            if (info[i].kind == detail::FieldKind::KV) {
+                any_kv = true;
+                width = std::max(width, 2 + info[i].len + short_size + 6);
+            } else if (info[i].kind == detail::FieldKind::FLAG) {
+                width = std::max(width, 2 + info[i].len + short_size);
+            } else {
+                width = std::max(width, info[i].len);
+            }
+        }
+        width += 2;
+
+        if (any_kv) {
+            text += " [OPTIONS] ";
+        }
+        text += "[FLAGS] ";
+        for (size_t p = 0; p < num_pos; p++) {
+            text += "<";
+            text += info[pos_idx[p]].key;
+            text += "> ";
+        }
+        text += "\n";
+
+        auto row = [&](std::string left, const char* desc) {
+            text += "\t" + left;
+            text.append(width - left.size(), ' ');
+            text += desc;
+            text += "\n";
+        };
+        auto keyed = [&](const detail::FieldInfo& f) {
+            std::string left = std::string("--") + f.key;
+            if (*f.short_key) {
+                left += std::string(", -") + f.short_key;
+            }
+            return left;
+        };
+
+        if (num_pos) {
+            text += "\nARGS:\n";
+            for (size_t p = 0; p < num_pos; p++) {
+                row(info[pos_idx[p]].key, info[pos_idx[p]].desc);
+            }
+        }
+        if (any_kv) {
+            text += "\nOPTIONS:\n";
+            for (size_t i = 0; i < N; i++) {
+                if (info[i].kind == detail::FieldKind::KV) {
+                    row(keyed(info[i]) + " <val>", info[i].desc);
+                }
+            }
+        }
+        text += "\nFLAGS:\n";
+        for (size_t i = 0; i < N; i++) {
+            if (info[i].kind == detail::FieldKind::FLAG) {
+                row(keyed(info[i]), info[i].desc);
+            }
+        }
+        row("--help, -h", "Print help message");
+        detail::write_all(stderr, text.data(), text.size());
+    }
+
+private:
+    ARGS_CONSTEXPR14 const char* check() {
+        if (N > 255) {
+            return "more than 255 fields";
+        }
+        for (size_t i = 0; i < N; i++) {
+            if (info[i].kind == detail::FieldKind::POS) {
+                pos_idx[num_pos++] = (uint32_t)i;
+                continue;
+            }
+            if (info[i].len == 0) {
+                return "a key is empty";
+            }
+            if (detail::same_str(info[i].key, "help")) {
+                return "\"help\" is reserved for the builtin help flag";
+            }
+            for (size_t c = 0; c < info[i].len; c++) {
+                if (info[i].key[c] == '=') {
+                    return "a key contains \"=\"";
+                }
+            }
+            for (size_t j = 0; j < i; j++) {
+                if (info[j].kind != detail::FieldKind::POS && detail::same_str(info[i].key, info[j].key)) {
+                    return "two fields have the same key";
+                }
+            }
+
+            const char* s = info[i].short_key;
+            if (s[0] != '\0') {
+                if (s[1] != '\0') {
+                    return "a short key is more than one character";
+                }
+                if (s[0] == 'h') {
+                    return "\"h\" is reserved for the builtin help flag";
+                }
+                if (short_idx[(uint8_t)s[0]] != 0) {
+                    return "two fields have the same short key";
+                }
+                short_idx[(uint8_t)s[0]] = (uint8_t)(i + 1);
+            }
+        }
+        return nullptr;
+    }
+
+    // Index of the keyed field with key, or N
+    size_t find_long_key(StringView key) const {
+        for (size_t i = 0; i < N; i++) {
+            if (info[i].len == key.size() && info[i].kind != detail::FieldKind::POS &&
+                memcmp(info[i].key, key.data(), key.size()) == 0) {
+                return i;
+            }
+        }
+        return N;
+    }
+
+    const char* app_name;
+    detail::FieldList<S, Fields...> list;
+    detail::FieldInfo info[N ? N : 1];
+    // Positional fields in order, and by short key the field index plus one
+    uint32_t pos_idx[N ? N : 1];
+    uint32_t num_pos = 0;
+    uint8_t short_idx[256];
+    const char* err = nullptr;
+};
+
+template<typename S, typename... Fields>
+ARGS_CONSTEXPR14 StructSchema<S, Fields...> make_struct_schema(const char* app_name, Fields... fields) {
+    return StructSchema<S, Fields...>(app_name, fields...);
+}
 
 
 
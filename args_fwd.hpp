@@ -0,0 +1,44 @@
+#pragma once
+
+// Forward declarations of args.hpp's public types, for headers that only
+// pass arguments, schemas or results around by reference. Files that
+// declare or parse arguments include args.hpp.
+
+namespace args {
+
+class StringView;
+
+enum class Status;
+struct Result;
+
+class ArgBase;
+class PosArgBase;
+class VarArgBase;
+class KVArgBase;
+class FlagArg;
+class SubcommandBase;
+
+template<typename T> class PosArg;
+template<typename T> class VarArg;
+template<typename T> class KVArg;
+template<typename T> class LazyKVArg;
+template<typename T> class Subcommand;
+
+class MemoryResource;
+class Arena;
+
+class TokenSource;
+class ArgvSource;
+class BufferSource;
+class FdSource;
+
+struct ParseStats;
+class ParseState;
+class BatchResult;
+
+class Schema;
+class Parser;
+
+template<typename S, typename... Fields> class StructSchema;
+
+} // namespace args
@@ -0,0 +1,118 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Schema::parse_batch throughput on recorded-invocation-sized command lines
+// (a dozen tokens each) as the thread count doubles, against one thread
+// calling Schema::parse in a loop.
+//
+//   ./bench_batch            1M lines
+//   ./bench_batch quick      100k lines
+
+int main(int argc, char** argv) {
+    bool quick = argc > 1 && strcmp(argv[1], "quick") == 0;
+    const size_t n_lines = quick ? 100000 : 1000000;
+    const int reps = 3;
+
+    Schema schema("bench");
+    KVArg<int> count(schema, "count", "c", "count");
+    KVArg<double> rate(schema, "rate", "r", "rate");
+    KVArg<std::string> name(schema, "name", "n", "name");
+    KVArg<int> port(schema, "port", "p", "port");
+    FlagArg verbose(schema, "verbose", "v", "verbose");
+    FlagArg dry_run(schema, "dry-run", "d", "dry run");
+    PosArg<int> id(schema, "id", "id");
+    VarArg<int> rest(schema, "rest", "the rest");
+
+    std::mt19937 rng(11);
+    std::vector<std::vector<std::string>> storage(n_lines);
+    for (auto& line : storage) {
+        line.push_back("bench");
+        line.push_back(std::to_string(rng() % 100000));
+        line.push_back("--count=" + std::to_string(rng() % 1000));
+        line.push_back("-r");
+        line.push_back(std::to_string(rng() % 1000) + ".25");
+        line.push_back("--port");
+        line.push_back(std::to_string(1024 + rng() % 60000));
+        if (rng() % 2) { line.push_back("-v"); }
+        if (rng() % 4 == 0) { line.push_back("--dry-run"); }
+        line.push_back("--name=job" + std::to_string(rng() % 100));
+        for (unsigned n = rng() % 5; n > 0; n--) { line.push_back(std::to_string(rng() % 100)); }
+    }
+
+    std::vector<std::vector<const char*>> argvs(n_lines);
+    std::vector<CommandLine> lines;
+    size_t tokens = 0;
+    for (size_t i = 0; i < n_lines; i++) {
+        for (auto& s : storage[i]) { argvs[i].push_back(s.c_str()); }
+        lines.push_back(CommandLine{(int)argvs[i].size(), argvs[i].data()});
+        tokens += argvs[i].size() - 1;
+    }
+
+    typedef std::chrono::steady_clock Clock;
+
+    // Sequential reference, also the checksum the batches must match
+    long long expected = 0;
+    double seq_ns = 1e300;
+    ParseState state(true);
+    for (int r = 0; r < reps; r++) {
+        long long sum = 0;
+        auto t0 = Clock::now();
+        for (auto& line : lines) {
+            if (schema.parse(line.argc, line.argv, state)) {
+                sum += *id + *count + port.value_or(0) + *verbose + (long long)(*rest).size();
+            }
+        }
+        auto t1 = Clock::now();
+        seq_ns = std::min(seq_ns, std::chrono::duration<double, std::nano>(t1 - t0).count());
+        expected = sum;
+    }
+
+    printf("%zu lines, %.1f tokens/line, %u hardware threads\n\n",
+        n_lines, (double)tokens / n_lines, std::thread::hardware_concurrency());
+    printf("%-12s %8s %12s %10s %9s\n", "mode", "threads", "Mlines/s", "ns/line", "speedup");
+    printf("%-12s %8u %12.2f %10.1f %9s\n", "parse", 1u, n_lines / seq_ns * 1e3, seq_ns / n_lines, "");
+
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    double one_thread_ns = 0;
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+        ThreadPool pool(threads);
+        double best = 1e300;
+        for (int r = 0; r < reps; r++) {
+            auto t0 = Clock::now();
+            BatchResult batch = schema.parse_batch(lines, pool);
+            auto t1 = Clock::now();
+            best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count());
+
+            long long sum = 0;
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (batch[i]) {
+                    sum += batch.value_or(i, id, 0) + batch.value_or(i, count, 0) + batch.value_or(i, port, 0)
+                         + batch.found(i, verbose);
+                    for (const BatchValue* v = batch.begin(i); v != batch.end(i); v++) {
+                        sum += v->arg == rest.get_id();
+                    }
+                }
+            }
+            if (sum != expected) {
+                fprintf(stderr, "checksum mismatch: parse %lld, batch %lld\n", expected, sum);
+                return 1;
+            }
+        }
+
+        if (threads == 1) { one_thread_ns = best; }
+        printf("%-12s %8u %12.2f %10.1f %8.2fx\n", "parse_batch", threads,
+            n_lines / best * 1e3, best / n_lines, one_thread_ns / best);
+
+        if (threads == max_threads) { break; }
+    }
+}
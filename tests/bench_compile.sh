@@ -0,0 +1,77 @@
+#!/usr/bin/env bash
+# Compile time of a file declaring options, with the header compiled in
+# (header-only) and against libargs (ARGS_SEPARATE_COMPILATION), for files
+# of 10 and 100 options. Then the one-off cost of libargs itself, and a
+# check that both builds link and parse.
+#
+#   ./bench_compile.sh            CXX and CXXFLAGS are honored
+
+set -e
+cd "$(dirname "$0")"
+
+CXX=${CXX:-c++}
+FLAGS="-std=c++11 -pthread -I../ -O2 -DNDEBUG $CXXFLAGS"
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# A tool's main: n options of the common types, a flag, a positional and
+# varargs
+gen() {
+    local n=$1
+    echo '#include "args.hpp"'
+    echo 'using namespace args;'
+    echo 'int tool_main(int argc, const char** argv) {'
+    echo '    Parser parser("tool", argc, argv);'
+    echo '    int sum = 0;'
+    for ((i = 0; i < n; i++)); do
+        case $((i % 4)) in
+        0) echo "    KVArg<int> o$i(parser, \"option-$i\", \"\", \"\");" ;;
+        1) echo "    KVArg<double> o$i(parser, \"option-$i\", \"\", \"\");" ;;
+        2) echo "    KVArg<std::string> o$i(parser, \"option-$i\", \"\", \"\");" ;;
+        3) echo "    LazyKVArg<long> o$i(parser, \"option-$i\", \"\", \"\");" ;;
+        esac
+    done
+    echo '    FlagArg verbose(parser, "verbose", "v", "");'
+    echo '    PosArg<std::string> input(parser, "input", "");'
+    echo '    VarArg<int> rest(parser, "rest", "");'
+    echo '    if (!parser.parse()) { return 1; }'
+    echo '    if (o0) { sum += *o0; }'
+    echo '    return sum + (int)rest.value().size();'
+    echo '}'
+}
+
+# Best of three wall-clock seconds
+best() {
+    local best=
+    for _ in 1 2 3; do
+        local t0 t1
+        t0=$(date +%s%N)
+        "$@"
+        t1=$(date +%s%N)
+        local ms=$(( (t1 - t0) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then best=$ms; fi
+    done
+    printf '%d.%03d' $((best / 1000)) $((best % 1000))
+}
+
+printf '%8s %14s %14s %12s %12s\n' options "header-only s" "separate s" "header-only" separate
+for n in 10 100; do
+    gen "$n" > "$TMP/tool_$n.cpp"
+    a=$(best $CXX $FLAGS -c "$TMP/tool_$n.cpp" -o "$TMP/inline_$n.o")
+    b=$(best $CXX $FLAGS -DARGS_SEPARATE_COMPILATION -c "$TMP/tool_$n.cpp" -o "$TMP/sep_$n.o")
+    printf '%8d %14s %14s %11dB %11dB\n' "$n" "$a" "$b" \
+        "$(wc -c < "$TMP/inline_$n.o")" "$(wc -c < "$TMP/sep_$n.o")"
+done
+
+printf '\nlibargs (once): %s s\n' "$(best $CXX $FLAGS -c ../args.cpp -o "$TMP/args.o")"
+
+cat > "$TMP/main.cpp" <<'EOF'
+int tool_main(int argc, const char** argv);
+int main() {
+    const char* argv[] = {"tool", "--option-0", "3", "in", "4", "5"};
+    return tool_main(6, argv) == 5 ? 0 : 1;
+}
+EOF
+$CXX $FLAGS "$TMP/main.cpp" "$TMP/inline_10.o" -o "$TMP/inline"
+$CXX $FLAGS "$TMP/main.cpp" "$TMP/sep_10.o" "$TMP/args.o" -o "$TMP/sep"
+"$TMP/inline" && "$TMP/sep" && echo "both builds parse"
@@ -0,0 +1,89 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Completion latency: Schema::complete for a three-character prefix, against
+// a linear scan over the keys, for schemas of 10 to 10000 long keys. Also
+// the cost of one abbreviated key during a parse, against the exact key.
+//
+//   ./bench_complete
+
+typedef std::chrono::steady_clock Clock;
+
+template<typename F>
+static double best_ns(int reps, int iters, F f) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = Clock::now();
+        for (int i = 0; i < iters; i++) { f(i); }
+        auto t1 = Clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / iters);
+    }
+    return best;
+}
+
+int main() {
+    printf("%8s %12s %12s %10s %12s %12s\n", "keys", "complete ns", "linear ns", "matches", "exact ns", "abbrev ns");
+    for (size_t n : {10, 100, 1000, 10000}) {
+        // Keys share prefixes in runs of ten: "alpha-0-...", "alpha-1-", ...
+        static const char* words[] = {"alpha", "bravo", "charlie", "delta", "echo", "foxtrot"};
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < n; i++) {
+            keys.push_back(std::string(words[i % 6]) + "-" + std::to_string(i / 6) + "-opt");
+        }
+
+        Schema schema("bench");
+        std::vector<std::unique_ptr<KVArg<int>>> kvs;
+        for (auto& k : keys) {
+            kvs.emplace_back(new KVArg<int>(schema, k.c_str(), "", ""));
+        }
+        schema.enable_abbreviations();
+
+        StringView out[64];
+        size_t matches = 0;
+        double complete_ns = best_ns(5, 100000, [&](int i) {
+            static const char* prefixes[] = {"alp", "cha", "fox", "zul"};
+            matches += schema.complete(prefixes[i & 3], out, 64);
+        });
+
+        double linear_ns = best_ns(5, 100000 / (int)std::max<size_t>(1, n / 100), [&](int i) {
+            static const char* prefixes[] = {"alp", "cha", "fox", "zul"};
+            StringView prefix(prefixes[i & 3]);
+            size_t found = 0;
+            for (auto& k : keys) {
+                if (StringView(k).starts_with(prefix)) {
+                    if (found < 64) { out[found] = StringView(k); }
+                    found++;
+                }
+            }
+            matches += found;
+        });
+
+        // The last key, exactly and by a unique prefix
+        std::string exact = "--" + keys.back() + "=1";
+        std::string abbrev = "--" + keys.back().substr(0, keys.back().size() - 3) + "=1";
+        ParseState state(true);
+        auto parse_ns = [&](const std::string& token) {
+            const char* argv[] = {"bench", token.c_str()};
+            return best_ns(5, 20000, [&](int) {
+                auto res = schema.parse(2, argv, state);
+                if (!res) {
+                    fprintf(stderr, "parse failed\n");
+                    exit(1);
+                }
+            });
+        };
+        double exact_ns = parse_ns(exact);
+        double abbrev_ns = parse_ns(abbrev);
+
+        printf("%8zu %12.1f %12.1f %10zu %12.1f %12.1f\n", n, complete_ns, linear_ns,
+            schema.complete("alp", out, 64), exact_ns, abbrev_ns);
+    }
+}
@@ -0,0 +1,67 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdio>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Times Converter<T> (the built-in float path) against IStreamConverter<T>
+// (the pre-Converter behavior) on the kinds of values sweep tools pass.
+
+static std::vector<std::string> make_inputs(size_t n) {
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::vector<std::string> out;
+    char buf[64];
+
+    for (size_t i = 0; i < n; i++) {
+        switch (i % 4) {
+            case 0: snprintf(buf, sizeof(buf), "%.3g", unit(rng)); break;
+            case 1: snprintf(buf, sizeof(buf), "%ge-%d", 1 + 9 * unit(rng), (int)(rng() % 8)); break;
+            case 2: snprintf(buf, sizeof(buf), "%.17g", unit(rng) * 1e6); break;
+            default: snprintf(buf, sizeof(buf), "%d.%d", (int)(rng() % 1000), (int)(rng() % 100)); break;
+        }
+        out.push_back(buf);
+    }
+    return out;
+}
+
+template<typename Conv, typename T>
+static double run(const char* name, const std::vector<std::string>& inputs, int reps) {
+    typedef std::chrono::steady_clock Clock;
+    T sum = 0;
+
+    auto start = Clock::now();
+    for (int r = 0; r < reps; r++) {
+        for (auto& s : inputs) {
+            T v = 0;
+            if (!Conv::parse(s, v)) {
+                fprintf(stderr, "%s: failed on %s\n", name, s.c_str());
+                exit(1);
+            }
+            sum += v;
+        }
+    }
+    auto end = Clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    double per = ns / ((double)inputs.size() * reps);
+    printf("%-28s %8.1f ns/value  (checksum %g)\n", name, per, (double)sum);
+    return per;
+}
+
+int main() {
+    auto inputs = make_inputs(100000);
+    const int reps = 10;
+
+    double a = run<IStreamConverter<double>, double>("istream<double>", inputs, reps);
+    double b = run<Converter<double>, double>("Converter<double>", inputs, reps);
+    printf("%-28s %8.1fx\n", "speedup", a / b);
+
+    a = run<IStreamConverter<float>, float>("istream<float>", inputs, reps);
+    b = run<Converter<float>, float>("Converter<float>", inputs, reps);
+    printf("%-28s %8.1fx\n", "speedup", a / b);
+}
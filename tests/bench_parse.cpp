@@ -0,0 +1,273 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "args.hpp"
+#include "reference/args_baseline.hpp"
+#include "count_allocs.hpp"
+
+// Parser throughput on synthetic schemas and argvs, against the baseline
+// parser checked in under reference/. Every performance change to args.hpp
+// should be measured with this.
+//
+//   ./bench_parse            full grid
+//   ./bench_parse quick      small grid, for a fast sanity check
+//
+// The "reused" rows build one Schema and parse every rep against it; their
+// setup column is that one-time cost, not a per-parse one.
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementations under test
+////////////////////////////////////////////////////////////////////////////////
+
+struct Current {
+    static const char* name() { return "args"; }
+    typedef args::Parser Parser;
+    template<typename T> using KV = args::KVArg<T>;
+    typedef args::FlagArg Flag;
+    template<typename T> using Pos = args::PosArg<T>;
+    template<typename T> using Var = args::VarArg<T>;
+};
+
+struct Baseline {
+    static const char* name() { return "baseline"; }
+    typedef args_baseline::Parser Parser;
+    template<typename T> using KV = args_baseline::KVArg<T>;
+    typedef args_baseline::FlagArg Flag;
+    template<typename T> using Pos = args_baseline::PosArg<T>;
+    template<typename T> using Var = args_baseline::VarArg<T>;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Synthetic schemas and argvs
+////////////////////////////////////////////////////////////////////////////////
+
+// Half the options are KVArg<int>, half FlagArg; the first 50 get short keys.
+// There are always two positionals and a VarArg<int>.
+struct Spec {
+    std::vector<std::string> kv_keys, kv_short;
+    std::vector<std::string> flag_keys, flag_short;
+
+    explicit Spec(size_t n_options) {
+        const char* letters = "abcdefgijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        size_t next_short = 0;
+        for (size_t i = 0; i < n_options; i++) {
+            std::string key = "option-" + std::to_string(i);
+            std::string short_key;
+            if (next_short < 50) { short_key = std::string(1, letters[next_short++]); }
+
+            if (i % 2 == 0) {
+                kv_keys.push_back(key);
+                kv_short.push_back(short_key);
+            } else {
+                flag_keys.push_back(key);
+                flag_short.push_back(short_key);
+            }
+        }
+    }
+};
+
+// Roughly: 25% "--k v", 20% "--k=v", 15% short kv, 15% flags, 25% varargs
+static std::vector<std::string> make_tokens(const Spec& spec, size_t n_tokens, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::string> toks;
+    toks.push_back("1");
+    toks.push_back("2");
+
+    while (toks.size() < n_tokens) {
+        unsigned kind = rng() % 100;
+        size_t kv = rng() % spec.kv_keys.size();
+        size_t flag = rng() % spec.flag_keys.size();
+        std::string val = std::to_string(rng() % 100000);
+
+        if (kind < 25) {
+            toks.push_back("--" + spec.kv_keys[kv]);
+            toks.push_back(val);
+        } else if (kind < 45) {
+            toks.push_back("--" + spec.kv_keys[kv] + "=" + val);
+        } else if (kind < 60 && !spec.kv_short[kv].empty()) {
+            if (rng() % 2) {
+                toks.push_back("-" + spec.kv_short[kv] + val);
+            } else {
+                toks.push_back("-" + spec.kv_short[kv]);
+                toks.push_back(val);
+            }
+        } else if (kind < 75) {
+            if (!spec.flag_short[flag].empty() && rng() % 2) {
+                toks.push_back("-" + spec.flag_short[flag]);
+            } else {
+                toks.push_back("--" + spec.flag_keys[flag]);
+            }
+        } else {
+            toks.push_back(val);
+        }
+    }
+    return toks;
+}
+
+template<typename Impl>
+struct Schema {
+    std::vector<std::unique_ptr<typename Impl::template KV<int>>> kvs;
+    std::vector<std::unique_ptr<typename Impl::Flag>> flags;
+    typename Impl::template Pos<int> pos_a;
+    typename Impl::template Pos<int> pos_b;
+    typename Impl::template Var<int> rest;
+
+    template<typename Parser>
+    Schema(Parser& parser, const Spec& spec)
+    : pos_a(parser, "a", "first positional"), pos_b(parser, "b", "second positional"),
+      rest(parser, "rest", "the rest") {
+        for (size_t i = 0; i < spec.kv_keys.size(); i++) {
+            kvs.emplace_back(new typename Impl::template KV<int>(parser,
+                spec.kv_keys[i].c_str(), spec.kv_short[i].c_str(), "key-value option"));
+        }
+        for (size_t i = 0; i < spec.flag_keys.size(); i++) {
+            flags.emplace_back(new typename Impl::Flag(parser,
+                spec.flag_keys[i].c_str(), spec.flag_short[i].c_str(), "flag option"));
+        }
+    }
+
+    long long checksum() const {
+        long long sum = *pos_a + *pos_b + (long long)(*rest).size();
+        for (auto& kv : kvs) { sum += kv->found() ? kv->value() : 0; }
+        for (auto& flag : flags) { sum += flag->found(); }
+        return sum;
+    }
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Driver
+////////////////////////////////////////////////////////////////////////////////
+
+struct Measurement {
+    double setup_us;
+    double parse_ns_per_token;
+    double parse_allocs;
+    long long checksum;
+};
+
+template<typename Impl>
+static Measurement measure(const Spec& spec, std::vector<const char*>& argv, int reps) {
+    typedef std::chrono::steady_clock Clock;
+    double setup_ns = 0, parse_ns = 0;
+    size_t allocs = 0;
+    long long checksum = 0;
+
+    for (int r = 0; r < reps; r++) {
+        auto t0 = Clock::now();
+        typename Impl::Parser parser("bench", (int)argv.size(), argv.data(), true);
+        Schema<Impl> schema(parser, spec);
+
+        auto t1 = Clock::now();
+        size_t allocs_before = g_allocs;
+        auto res = parser.parse();
+        allocs += g_allocs - allocs_before;
+        auto t2 = Clock::now();
+
+        if (!res) {
+            fprintf(stderr, "%s: parse failed\n", Impl::name());
+            exit(1);
+        }
+
+        setup_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+        parse_ns += std::chrono::duration<double, std::nano>(t2 - t1).count();
+        checksum = schema.checksum();
+    }
+
+    Measurement m;
+    m.setup_us = setup_ns / reps / 1e3;
+    m.parse_ns_per_token = parse_ns / reps / (double)(argv.size() - 1);
+    m.parse_allocs = (double)allocs / reps;
+    m.checksum = checksum;
+    return m;
+}
+
+// One args::Schema built up front and parsed against every rep, so setup is
+// paid once and each parse only resets state and scans tokens.
+static Measurement measure_reused(const Spec& spec, std::vector<const char*>& argv, int reps) {
+    typedef std::chrono::steady_clock Clock;
+    double parse_ns = 0;
+    size_t allocs = 0;
+
+    auto t0 = Clock::now();
+    args::Schema parser("bench");
+    Schema<Current> schema(parser, spec);
+    args::ParseState state(true);
+    auto t1 = Clock::now();
+
+    for (int r = 0; r < reps; r++) {
+        auto t2 = Clock::now();
+        size_t allocs_before = g_allocs;
+        auto res = parser.parse((int)argv.size(), argv.data(), state);
+        allocs += g_allocs - allocs_before;
+        auto t3 = Clock::now();
+
+        if (!res) {
+            fprintf(stderr, "reused: parse failed\n");
+            exit(1);
+        }
+        parse_ns += std::chrono::duration<double, std::nano>(t3 - t2).count();
+    }
+
+    Measurement m;
+    m.setup_us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+    m.parse_ns_per_token = parse_ns / reps / (double)(argv.size() - 1);
+    m.parse_allocs = (double)allocs / reps;
+    m.checksum = schema.checksum();
+    return m;
+}
+
+static void print_row(const char* impl, size_t options, size_t tokens, const Measurement& m) {
+    printf("%-9s %8zu %9zu %11.1f %10.1f %9.2f %12.1f\n", impl, options, tokens,
+        m.setup_us, m.parse_ns_per_token, 1e3 / m.parse_ns_per_token, m.parse_allocs);
+}
+
+int main(int argc, char** argv) {
+    bool quick = argc > 1 && strcmp(argv[1], "quick") == 0;
+
+    std::vector<size_t> option_counts = {10, 100, 1000};
+    std::vector<size_t> token_counts = {10, 1000, 100000, 1000000};
+    if (quick) {
+        option_counts = {10, 100};
+        token_counts = {10, 1000, 100000};
+    }
+
+    printf("%-9s %8s %9s %11s %10s %9s %12s\n",
+        "impl", "options", "tokens", "setup(us)", "ns/token", "Mtok/s", "allocs/parse");
+
+    for (size_t options : option_counts) {
+        Spec spec(options);
+        for (size_t tokens : token_counts) {
+            auto storage = make_tokens(spec, tokens, (unsigned)(options * 31 + tokens));
+            std::vector<const char*> args(1, "bench");
+            for (auto& s : storage) { args.push_back(s.c_str()); }
+
+            int reps = (int)std::max<size_t>(1, (quick ? 200000 : 2000000) / tokens);
+            reps = std::min(reps, 10000);
+
+            auto base = measure<Baseline>(spec, args, reps);
+            auto cur = measure<Current>(spec, args, reps);
+            auto reused = measure_reused(spec, args, reps);
+            if (base.checksum != cur.checksum || base.checksum != reused.checksum) {
+                fprintf(stderr, "checksum mismatch: baseline %lld, args %lld, reused %lld\n",
+                    base.checksum, cur.checksum, reused.checksum);
+                return 1;
+            }
+
+            print_row(Baseline::name(), options, args.size() - 1, base);
+            print_row(Current::name(), options, args.size() - 1, cur);
+            print_row("reused", options, args.size() - 1, reused);
+            printf("%-9s %8s %9s %11.2fx %9.2fx\n", "speedup", "", "",
+                base.setup_us / cur.setup_us, base.parse_ns_per_token / cur.parse_ns_per_token);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <cstdio>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Parses an argv made almost entirely of short options (bundled values like
+// -n3, separate values like -n 3, and flags) to time short key resolution.
+
+int main() {
+    const char* letters = "abcdefgijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    const size_t n_letters = strlen(letters);
+    const size_t n_tokens = 100000;
+    const int reps = 20;
+
+    std::vector<std::string> long_keys;
+    std::vector<std::string> short_keys;
+    for (size_t i = 0; i < n_letters; i++) {
+        long_keys.push_back("opt_" + std::to_string(i));
+        short_keys.push_back(std::string(1, letters[i]));
+    }
+
+    // Even letters take an int, odd letters are flags
+    std::mt19937 rng(1);
+    std::vector<std::string> storage;
+    while (storage.size() < n_tokens) {
+        size_t i = rng() % n_letters;
+        if (i % 2 == 0) {
+            if (rng() % 2) {
+                storage.push_back("-" + short_keys[i] + std::to_string(rng() % 1000));
+            } else {
+                storage.push_back("-" + short_keys[i]);
+                storage.push_back(std::to_string(rng() % 1000));
+            }
+        } else {
+            storage.push_back("-" + short_keys[i]);
+        }
+    }
+
+    std::vector<const char*> argv(1, "bench");
+    for (auto& s : storage) { argv.push_back(s.c_str()); }
+
+    typedef std::chrono::steady_clock Clock;
+    double total_ns = 0;
+    long long checksum = 0;
+
+    for (int r = 0; r < reps; r++) {
+        auto start = Clock::now();
+
+        Parser parser("bench", (int)argv.size(), argv.data(), true);
+        std::vector<std::unique_ptr<KVArg<int>>> kvs;
+        std::vector<std::unique_ptr<FlagArg>> flags;
+        for (size_t i = 0; i < n_letters; i++) {
+            if (i % 2 == 0) {
+                kvs.emplace_back(new KVArg<int>(parser, long_keys[i].c_str(), short_keys[i].c_str(), ""));
+            } else {
+                flags.emplace_back(new FlagArg(parser, long_keys[i].c_str(), short_keys[i].c_str(), ""));
+            }
+        }
+
+        auto res = parser.parse();
+        total_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        if (!res) {
+            fprintf(stderr, "parse failed: %s\n", res.item.str().c_str());
+            return 1;
+        }
+        for (auto& kv : kvs) { checksum += kv->value_or(0); }
+    }
+
+    double tokens = (double)(argv.size() - 1) * reps;
+    printf("short options: %zu tokens x %d: %.1f ns/token, %.1f M tokens/s (checksum %lld)\n",
+        argv.size() - 1, reps, total_ns / tokens, tokens / total_ns * 1e3, checksum);
+}
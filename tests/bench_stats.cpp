@@ -0,0 +1,86 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Cost of ParseStats: the same command line parsed with no stats, and with
+// a ParseStats counting and timing every token, for schemas of 10 to 1000
+// long keys. Prints the stats of the last run.
+//
+//   ./bench_stats
+
+typedef std::chrono::steady_clock Clock;
+
+template<typename F>
+static double best_ns(int reps, int iters, F f) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = Clock::now();
+        for (int i = 0; i < iters; i++) { f(i); }
+        auto t1 = Clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / iters);
+    }
+    return best;
+}
+
+int main() {
+    printf("%8s %8s %14s %14s %10s\n", "keys", "tokens", "off ns/token", "on ns/token", "overhead");
+    ParseStats stats;
+    for (size_t n : {10, 100, 1000}) {
+        Schema schema("bench");
+        std::vector<std::string> keys;
+        keys.reserve(n);
+        std::vector<std::unique_ptr<KVArg<int>>> kvs;
+        std::vector<std::unique_ptr<KVArg<std::string>>> strs;
+        for (size_t i = 0; i < n; i++) {
+            keys.push_back("option-" + std::to_string(i));
+            if (i % 4 == 3) {
+                strs.emplace_back(new KVArg<std::string>(schema, keys.back().c_str(), "", ""));
+            } else {
+                kvs.emplace_back(new KVArg<int>(schema, keys.back().c_str(), "", ""));
+            }
+        }
+        FlagArg verbose(schema, "verbose", "v", "");
+        VarArg<double> rest(schema, "rest", "");
+
+        // --key value, --key=value, -v and positionals, over every key
+        std::vector<std::string> toks;
+        for (size_t i = 0; i < 1000; i++) {
+            const std::string& k = keys[(i * 7) % n];
+            switch (i % 4) {
+            case 0: toks.push_back("--" + k); toks.push_back(std::to_string(i)); break;
+            case 1: toks.push_back("--" + k + "=" + std::to_string(i)); break;
+            case 2: toks.push_back("-v"); break;
+            case 3: toks.push_back(std::to_string(i) + ".5"); break;
+            }
+        }
+        std::vector<const char*> argv(1, "bench");
+        for (auto& t : toks) { argv.push_back(t.c_str()); }
+        int argc = (int)argv.size();
+
+        ParseState off(true);
+        ParseState on(true);
+        on.set_stats(&stats);
+        size_t good = 0;
+        double off_ns = best_ns(7, 200, [&](int) {
+            good += (bool)schema.parse(argc, argv.data(), off);
+        });
+        double on_ns = best_ns(7, 200, [&](int) {
+            stats.reset();
+            good += (bool)schema.parse(argc, argv.data(), on);
+        });
+
+        size_t tokens = toks.size();
+        printf("%8zu %8zu %14.1f %14.1f %9.0f%%  (%zu)\n", n, tokens, off_ns / tokens, on_ns / tokens,
+               100 * (on_ns - off_ns) / off_ns, good % 10);
+    }
+    printf("\n");
+    stats.print(stdout);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Setup plus one parse of a typical command line (8 options, a flag and a
+// positional): a hand-written strcmp loop, a StructSchema, and a Parser.
+//
+//   ./bench_struct
+
+typedef std::chrono::steady_clock Clock;
+
+struct Opts {
+    int threads = 1;
+    int port = 80;
+    int retries = 3;
+    int timeout = 30;
+    double rate = 1.0;
+    double scale = 1.0;
+    int depth = 0;
+    int width = 0;
+    bool verbose = false;
+    int count = 0;
+};
+
+static const char* g_argv[] = {"bench", "--threads", "8", "--port=8080", "--retries", "5",
+    "-T", "60", "--rate", "0.5", "--scale=2.5", "--depth", "4", "-w", "12", "-v", "42"};
+static const int g_argc = sizeof(g_argv) / sizeof(g_argv[0]);
+
+static bool is(const char* a, size_t n, const char* key) {
+    return strlen(key) == n && memcmp(a, key, n) == 0;
+}
+
+static bool by_hand(int argc, const char** argv, Opts& o) {
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        const char* eq = strchr(a, '=');
+        size_t n = eq ? (size_t)(eq - a) : strlen(a);
+        const char* v = eq ? eq + 1 : (i + 1 < argc ? argv[i + 1] : nullptr);
+        bool used_next = !eq;
+        if (is(a, n, "--threads")) { o.threads = atoi(v); }
+        else if (is(a, n, "--port")) { o.port = atoi(v); }
+        else if (is(a, n, "--retries")) { o.retries = atoi(v); }
+        else if (is(a, n, "-T") || is(a, n, "--timeout")) { o.timeout = atoi(v); }
+        else if (is(a, n, "--rate")) { o.rate = strtod(v, nullptr); }
+        else if (is(a, n, "--scale")) { o.scale = strtod(v, nullptr); }
+        else if (is(a, n, "--depth")) { o.depth = atoi(v); }
+        else if (is(a, n, "-w") || is(a, n, "--width")) { o.width = atoi(v); }
+        else if (is(a, n, "-v") || is(a, n, "--verbose")) { o.verbose = true; used_next = false; }
+        else if (a[0] != '-') { o.count = atoi(a); used_next = false; }
+        else { return false; }
+        if (used_next) { i++; }
+    }
+    return true;
+}
+
+template<typename F>
+static double best_ns(F f) {
+    double best = 1e300;
+    for (int r = 0; r < 7; r++) {
+        const int iters = 20000;
+        auto t0 = Clock::now();
+        for (int i = 0; i < iters; i++) { f(); }
+        auto t1 = Clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / iters);
+    }
+    return best;
+}
+
+static volatile int g_sink;
+
+int main() {
+    double hand = best_ns([]() {
+        Opts o;
+        if (!by_hand(g_argc, g_argv, o)) { exit(1); }
+        g_sink = o.threads + o.count;
+    });
+
+    double structured = best_ns([]() {
+        static const auto schema = make_struct_schema<Opts>("bench",
+            kv_field("threads", "", &Opts::threads, ""),
+            kv_field("port", "", &Opts::port, ""),
+            kv_field("retries", "", &Opts::retries, ""),
+            kv_field("timeout", "T", &Opts::timeout, ""),
+            kv_field("rate", "", &Opts::rate, ""),
+            kv_field("scale", "", &Opts::scale, ""),
+            kv_field("depth", "", &Opts::depth, ""),
+            kv_field("width", "w", &Opts::width, ""),
+            flag_field("verbose", "v", &Opts::verbose, ""),
+            pos_field("count", &Opts::count, ""));
+        Opts o;
+        if (!schema.parse(g_argc, g_argv, o, true) || o.width != 12) { exit(1); }
+        g_sink = o.threads + o.count;
+    });
+
+    double parser = best_ns([]() {
+        Parser p("bench", g_argc, g_argv, true);
+        KVArg<int> threads(p, "threads", "", "");
+        KVArg<int> port(p, "port", "", "");
+        KVArg<int> retries(p, "retries", "", "");
+        KVArg<int> timeout(p, "timeout", "T", "");
+        KVArg<double> rate(p, "rate", "", "");
+        KVArg<double> scale(p, "scale", "", "");
+        KVArg<int> depth(p, "depth", "", "");
+        KVArg<int> width(p, "width", "w", "");
+        FlagArg verbose(p, "verbose", "v", "");
+        PosArg<int> count(p, "count", "");
+        if (!p.parse() || *width != 12) { exit(1); }
+        g_sink = *threads + *count;
+    });
+
+    printf("%-14s %10s %10s\n", "", "ns", "vs hand");
+    printf("%-14s %10.1f %9.2fx\n", "strcmp loop", hand, 1.0);
+    printf("%-14s %10.1f %9.2fx\n", "StructSchema", structured, structured / hand);
+    printf("%-14s %10.1f %9.2fx\n", "Parser", parser, parser / hand);
+}
@@ -0,0 +1,94 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Startup of a multi-tool: set up a schema and parse one invocation of one
+// subcommand, for tools of 10 to 500 subcommands with 30 options each.
+// "eager" builds every subcommand's arguments up front (as a tool without
+// subcommand support would); "lazy" registers Subcommands, which only build
+// the selected one.
+//
+//   ./bench_subcommand
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t options_per_command = 30;
+static std::vector<std::string> g_keys;
+
+struct Options {
+    std::vector<std::unique_ptr<KVArg<int>>> kvs;
+    explicit Options(Schema& schema) {
+        for (auto& k : g_keys) {
+            kvs.emplace_back(new KVArg<int>(schema, k.c_str(), "", "an option"));
+        }
+    }
+};
+
+template<typename F>
+static double best_us(int reps, F f) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = Clock::now();
+        f();
+        auto t1 = Clock::now();
+        best = std::min(best, std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    return best;
+}
+
+int main() {
+    for (size_t i = 0; i < options_per_command; i++) {
+        g_keys.push_back("option-" + std::to_string(i));
+    }
+
+    printf("%10s %10s %10s %10s\n", "commands", "eager us", "lazy us", "speedup");
+    for (size_t n : {10, 100, 500}) {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < n; i++) {
+            names.push_back("command-" + std::to_string(i));
+        }
+        std::string selected = names[n / 2];
+        const char* argv[] = {"tool", selected.c_str(), "--option-7", "7", "--option-29=29"};
+        const int argc = 5;
+
+        double eager = best_us(20, [&]() {
+            std::vector<std::unique_ptr<Schema>> schemas;
+            std::vector<std::unique_ptr<Options>> options;
+            for (size_t i = 0; i < n; i++) {
+                schemas.emplace_back(new Schema(names[i].c_str()));
+                options.emplace_back(new Options(*schemas.back()));
+            }
+            // Dispatch by hand, then parse the rest
+            ParseState state(true);
+            size_t i = n / 2;
+            if (strcmp(argv[1], names[i].c_str()) != 0 ||
+                !schemas[i]->parse(argc - 1, argv + 1, state) || **options[i]->kvs[29] != 29) {
+                fprintf(stderr, "parse failed\n");
+                exit(1);
+            }
+        });
+
+        double lazy = best_us(20, [&]() {
+            Schema tool("tool");
+            std::vector<std::unique_ptr<Subcommand<Options>>> commands;
+            for (size_t i = 0; i < n; i++) {
+                commands.emplace_back(new Subcommand<Options>(tool, names[i].c_str(), "a command"));
+            }
+            ParseState state(true);
+            Subcommand<Options>& command = *commands[n / 2];
+            if (!tool.parse(argc, argv, state) || !command || **command->kvs[29] != 29) {
+                fprintf(stderr, "parse failed\n");
+                exit(1);
+            }
+        });
+
+        printf("%10zu %10.1f %10.1f %9.1fx\n", n, eager, lazy, eager / lazy);
+    }
+}
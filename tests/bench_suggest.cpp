@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// "Did you mean" latency: Schema::suggest for a mistyped key, against the
+// textbook O(mn) edit distance DP over every key, for schemas of 10 to
+// 10000 long keys.
+//
+//   ./bench_suggest
+
+typedef std::chrono::steady_clock Clock;
+
+template<typename F>
+static double best_ns(int reps, int iters, F f) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = Clock::now();
+        for (int i = 0; i < iters; i++) { f(i); }
+        auto t1 = Clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / iters);
+    }
+    return best;
+}
+
+static size_t dp_distance(StringView a, StringView b, std::vector<size_t>& row) {
+    row.resize(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); j++) { row[j] = j; }
+    for (size_t i = 1; i <= a.size(); i++) {
+        size_t diag = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= b.size(); j++) {
+            size_t up = row[j];
+            row[j] = std::min(std::min(row[j] + 1, row[j - 1] + 1), diag + (a[i - 1] != b[j - 1]));
+            diag = up;
+        }
+    }
+    return row[b.size()];
+}
+
+int main() {
+    static const char* typos[] = {"max-connectoins", "log-levle", "timeout-ms-42", "verbos"};
+    printf("%8s %12s %12s %12s\n", "keys", "suggest ns", "dp ns", "speedup");
+    for (size_t n : {10, 100, 1000, 10000}) {
+        static const char* words[] = {"max-connections", "log-level", "timeout-ms", "verbose", "output-dir", "cache-size"};
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < n; i++) {
+            keys.push_back(std::string(words[i % 6]) + "-" + std::to_string(i / 6));
+        }
+
+        Schema schema("bench");
+        std::vector<std::unique_ptr<KVArg<int>>> kvs;
+        for (auto& k : keys) {
+            kvs.emplace_back(new KVArg<int>(schema, k.c_str(), "", ""));
+        }
+
+        StringView out[Result::max_suggestions];
+        size_t found = 0;
+        int iters = (int)std::max<size_t>(100, 1000000 / n);
+        double suggest_ns = best_ns(5, iters, [&](int i) {
+            found += schema.suggest(typos[i & 3], out, Result::max_suggestions);
+        });
+
+        std::vector<size_t> row;
+        double dp_ns = best_ns(5, std::max(10, iters / 10), [&](int i) {
+            StringView typo(typos[i & 3]);
+            size_t best = (size_t)-1;
+            for (auto& k : keys) {
+                best = std::min(best, dp_distance(typo, k, row));
+            }
+            found += best;
+        });
+
+        printf("%8zu %12.1f %12.1f %11.1fx  (%zu)\n", n, suggest_ns, dp_ns, dp_ns / suggest_ns, found % 10);
+    }
+}
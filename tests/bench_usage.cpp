@@ -0,0 +1,99 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "args.hpp"
+#include "reference/args_baseline.hpp"
+
+// Error-path latency: a parse that fails on an unknown key and prints the
+// usage, for schemas of 10 to 1000 options, against the baseline parser.
+// stderr goes to /dev/null while timing. "first" is a fresh args Parser,
+// which renders the usage text; "cached" reparses one Schema, which prints
+// the text it rendered before.
+//
+//   ./bench_usage
+
+typedef std::chrono::steady_clock Clock;
+static const char* g_argv[] = {"bench", "--bogus"};
+
+struct Options {
+    std::vector<std::string> keys, descs;
+
+    explicit Options(size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            keys.push_back("option-" + std::to_string(i));
+            descs.push_back("description of option " + std::to_string(i));
+        }
+    }
+
+    template<typename KV, typename Flag, typename Parser>
+    void add(Parser& parser, std::vector<std::unique_ptr<KV>>& kvs, std::vector<std::unique_ptr<Flag>>& flags) const {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (i % 2 == 0) {
+                kvs.emplace_back(new KV(parser, keys[i].c_str(), "", descs[i].c_str()));
+            } else {
+                flags.emplace_back(new Flag(parser, keys[i].c_str(), "", descs[i].c_str()));
+            }
+        }
+    }
+};
+
+template<typename Parser, typename KV, typename Flag>
+static double measure_fresh(const Options& options, int reps) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        Parser parser("bench", 2, g_argv, false);
+        std::vector<std::unique_ptr<KV>> kvs;
+        std::vector<std::unique_ptr<Flag>> flags;
+        options.add(parser, kvs, flags);
+
+        auto t0 = Clock::now();
+        auto res = parser.parse();
+        auto t1 = Clock::now();
+        if (res) { exit(1); }
+        best = std::min(best, std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    return best;
+}
+
+static double measure_cached(const Options& options, int reps) {
+    args::Schema schema("bench");
+    std::vector<std::unique_ptr<args::KVArg<int>>> kvs;
+    std::vector<std::unique_ptr<args::FlagArg>> flags;
+    options.add(schema, kvs, flags);
+    args::ParseState state;
+
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        auto t0 = Clock::now();
+        auto res = schema.parse(2, g_argv, state);
+        auto t1 = Clock::now();
+        if (res) { exit(1); }
+        best = std::min(best, std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    return best;
+}
+
+int main() {
+    int saved = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    const int reps = 50;
+
+    printf("%8s %14s %11s %12s %9s\n", "options", "baseline(us)", "first(us)", "cached(us)", "speedup");
+    for (size_t n : {10, 100, 1000}) {
+        Options options(n);
+
+        dup2(null_fd, STDERR_FILENO);
+        double base = measure_fresh<args_baseline::Parser, args_baseline::KVArg<int>, args_baseline::FlagArg>(options, reps);
+        double first = measure_fresh<args::Parser, args::KVArg<int>, args::FlagArg>(options, reps);
+        double cached = measure_cached(options, reps);
+        dup2(saved, STDERR_FILENO);
+
+        printf("%8zu %14.2f %11.2f %12.2f %8.2fx\n", n, base, first, cached, base / cached);
+    }
+}
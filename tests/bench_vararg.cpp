@@ -0,0 +1,76 @@
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+#include "args.hpp"
+
+using namespace args;
+
+// A single VarArg receiving a very long list, converted one token at a time,
+// deferred (collected, reserved once, converted after the scan), and
+// deferred across a ThreadPool.
+//
+//   ./bench_vararg            1M values
+//   ./bench_vararg quick      100k values
+
+template<typename T>
+static void run(const char* type, std::vector<const char*>& argv, ThreadPool& pool) {
+    typedef std::chrono::steady_clock Clock;
+    const int reps = 5;
+    size_t n = argv.size() - 1 - (argv.size() > 1 && strcmp(argv[1], "--") == 0);
+
+    const char* modes[] = {"one-by-one", "deferred", "parallel"};
+    double first_ns = 0;
+    for (int mode = 0; mode < 3; mode++) {
+        Schema schema("bench");
+        VarArg<T> vals(schema, "vals", "values");
+        if (mode == 1) { schema.enable_deferred_varargs(); }
+        if (mode == 2) { schema.enable_deferred_varargs(&pool); }
+        ParseState state(true);
+
+        double best = 1e300;
+        double checksum = 0;
+        for (int r = 0; r < reps; r++) {
+            auto t0 = Clock::now();
+            auto res = schema.parse((int)argv.size(), argv.data(), state);
+            auto t1 = Clock::now();
+            if (!res) {
+                fprintf(stderr, "parse failed\n");
+                exit(1);
+            }
+            best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count());
+            checksum = (double)(*vals)[n / 2] + (double)(*vals).back();
+        }
+
+        if (mode == 0) { first_ns = best; }
+        printf("%-8s %-11s %8u %10.1f %9.2fx  (checksum %g)\n", type, modes[mode],
+            mode == 2 ? pool.size() : 1u, best / n, first_ns / best, checksum);
+    }
+}
+
+int main(int argc, char** argv) {
+    bool quick = argc > 1 && strcmp(argv[1], "quick") == 0;
+    const size_t n = quick ? 100000 : 1000000;
+
+    std::mt19937_64 rng(12);
+    std::vector<std::string> doubles, ints;
+    for (size_t i = 0; i < n; i++) {
+        doubles.push_back(std::to_string(rng() % 1000000) + "." + std::to_string(rng() % 100000));
+        ints.push_back(std::to_string((int64_t)rng()));
+    }
+
+    // Negative values would otherwise read as short keys
+    std::vector<const char*> double_argv(1, "bench"), int_argv = {"bench", "--"};
+    for (auto& s : doubles) { double_argv.push_back(s.c_str()); }
+    for (auto& s : ints) { int_argv.push_back(s.c_str()); }
+
+    ThreadPool pool;
+    printf("%zu values\n\n", n);
+    printf("%-8s %-11s %8s %10s %10s\n", "type", "mode", "threads", "ns/value", "speedup");
+    run<double>("double", double_argv, pool);
+    run<int64_t>("int64_t", int_argv, pool);
+}
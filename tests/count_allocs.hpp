@@ -0,0 +1,31 @@
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <cstdlib>
+
+// Counts heap allocations by replacing the global operator new and delete.
+// The replacements are for the whole binary, so include this from exactly
+// one file of a program, and only in programs meant to count.
+
+static size_t g_allocs = 0;
+
+// Kept out of line: inlined, gcc pairs the malloc in operator new with
+// operator delete and warns (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+#define ARGS_TEST_NOINLINE __attribute__((noinline))
+#else
+#define ARGS_TEST_NOINLINE
+#endif
+
+ARGS_TEST_NOINLINE void* operator new(size_t n) {
+    g_allocs++;
+    void* p = malloc(n ? n : 1);
+    if (!p) { throw std::bad_alloc(); }
+    return p;
+}
+ARGS_TEST_NOINLINE void* operator new[](size_t n) { return operator new(n); }
+ARGS_TEST_NOINLINE void operator delete(void* p) noexcept { free(p); }
+ARGS_TEST_NOINLINE void operator delete[](void* p) noexcept { free(p); }
+ARGS_TEST_NOINLINE void operator delete(void* p, size_t) noexcept { free(p); }
+ARGS_TEST_NOINLINE void operator delete[](void* p, size_t) noexcept { free(p); }
@@ -0,0 +1,342 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Fuzz target for the parser: long and short keys, positionals, varargs,
+// abbreviations, suggestions, subcommands, whitespace-split sources, and
+// (on a fresh schema) config errors. Every schema is in no-exit mode, so a
+// bad schema is a CONFIG_ERROR rather than the end of the process, and
+// nothing prints.
+//
+// Input: byte 0 picks the settings. With its top bit set, the bytes up to
+// the first 0xff describe arguments to register on a fresh schema, three
+// bytes each (kind, then long and short key drawn from a small alphabet).
+// The rest is split on 0 bytes into argv tokens.
+//
+// Standalone, with no libFuzzer:
+//
+//   make fuzz
+//   ./fuzz                     10M random inputs
+//   ./fuzz -n 1000000 -s 7     1M inputs from seed 7
+//   ./fuzz crash-1234 ...      replay inputs from files
+//
+// With clang's libFuzzer, `make fuzz_libfuzzer`, then run it on a corpus
+// directory as usual.
+
+static const size_t max_tokens = 64;
+
+struct Sub {
+    KVArg<int> depth;
+    FlagArg all;
+    VarArg<std::string> paths;
+    explicit Sub(Schema& schema)
+    : depth(schema, "depth", "d", ""), all(schema, "all", "a", ""), paths(schema, "paths", "") {}
+};
+
+// Schemas reused across inputs, as a long-running program would
+struct Fixture {
+    Schema plain{"fuzz"};
+    PosArg<int> pos{plain, "pos", ""};
+    KVArg<int> i{plain, "int", "i", ""};
+    KVArg<double> d{plain, "double", "d", ""};
+    KVArg<uint64_t> u{plain, "u64", "u", ""};
+    KVArg<std::string> s{plain, "string", "s", ""};
+    KVArg<StringView> v{plain, "view", "w", ""};
+    LazyKVArg<int64_t> lazy{plain, "lazy", "l", ""};
+    KVArg<float> f{plain, "float-value", "", ""};
+    FlagArg verbose{plain, "verbose", "v", ""};
+    FlagArg version{plain, "version", "", ""};
+    VarArg<int> rest{plain, "rest", ""};
+
+    Schema tool{"tool"};
+    FlagArg quiet{tool, "quiet", "q", ""};
+    Subcommand<Sub> commit{tool, "commit", ""};
+    Subcommand<Sub> checkout{tool, "checkout", ""};
+    Subcommand<Sub> push{tool, "push", ""};
+
+    Fixture() {
+        plain.enable_no_exit();
+        plain.enable_deferred_varargs();
+        tool.enable_no_exit();
+        tool.enable_completion();
+        if (plain.config_error_message() || tool.config_error_message()) {
+            fprintf(stderr, "fixture: %s\n", plain.config_error_message());
+            abort();
+        }
+    }
+};
+
+static void check(const Result& res) {
+    if ((size_t)res.status >= sizeof(status_str) / sizeof(status_str[0])) {
+        abort();
+    }
+    if (res.suggestion_count > Result::max_suggestions) {
+        abort();
+    }
+    for (uint32_t i = 0; i < res.suggestion_count; i++) {
+        if (res.suggestions[i].size() == 0) {
+            abort();
+        }
+    }
+}
+
+static void parse_fresh(const uint8_t*& p, const uint8_t* end, int argc, const char** argv) {
+    static const char alphabet[] = "abhk=-";
+    Schema schema("fresh");
+    schema.enable_no_exit();
+    std::vector<std::unique_ptr<ArgBase>> owned;
+    // Keys must outlive the arguments
+    std::vector<std::string> keys;
+    keys.reserve(64);
+
+    for (int n = 0; p + 3 <= end && *p != 0xff && n < 16; n++, p += 3) {
+        std::string key(1 + p[1] % 3, alphabet[p[1] % 6]);
+        if (p[1] & 0x80) { key.clear(); }
+        keys.push_back(key);
+        const char* k = keys.back().c_str();
+        keys.push_back(p[2] & 1 ? std::string(1, alphabet[p[2] % 6]) : std::string(p[2] & 2 ? "xy" : ""));
+        const char* short_k = keys.back().c_str();
+
+        switch (p[0] % 5) {
+        case 0: owned.emplace_back(new KVArg<int>(schema, k, short_k, "")); break;
+        case 1: owned.emplace_back(new FlagArg(schema, k, short_k, "")); break;
+        case 2: owned.emplace_back(new PosArg<int>(schema, k, "")); break;
+        case 3: owned.emplace_back(new VarArg<int>(schema, k, "")); break;
+        case 4: owned.emplace_back(new LazyKVArg<double>(schema, k, short_k, "")); break;
+        }
+    }
+    if (p < end) { p++; }
+
+    ParseState state(true);
+    Result res = schema.parse(argc, argv, state);
+    if (res.status == Status::CONFIG_ERROR && !schema.config_error_message()) {
+        abort();
+    }
+    check(res);
+    if (res) {
+        check(schema.validate_all(state));
+    }
+}
+
+// Sign of StringView::compare as documented: the first differing byte
+// decides, and of a string and its prefix, the shorter is greater
+static int reference_compare(const std::string& a, const std::string& b) {
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    if (a.size() == b.size()) {
+        return 0;
+    }
+    return a.size() < b.size() ? 1 : -1;
+}
+
+static int sign(int x) { return (x > 0) - (x < 0); }
+
+// StringView's vectorized find, starts_with, == and compare against
+// std::string on the same bytes, at offsets and lengths the input picks
+static void check_string_view(const char* begin, const char* end) {
+    StringView view = StringView::from_range(begin, end);
+    std::string ref(begin, end);
+    size_t n = ref.size();
+    if (view.size() != n || view.str() != ref) {
+        abort();
+    }
+
+    size_t off = n ? (unsigned char)ref[0] % (n + 1) : 0;
+    size_t len = n > 1 ? (unsigned char)ref[1] % (n - off + 1) : n - off;
+    StringView sub = view.substr(off, len);
+    std::string ref_sub = ref.substr(off, len);
+    if (sub.str() != ref_sub || view.substr(off).str() != ref.substr(off)) {
+        abort();
+    }
+
+    const char chars[] = {'=', '-', '\0', n ? ref[n - 1] : 'x', (char)0x80};
+    for (char c : chars) {
+        for (size_t from : {(size_t)0, off, n}) {
+            size_t got = view.find(c, from);
+            size_t want = ref.find(c, from);
+            if (got != (want == std::string::npos ? StringView::npos : want)) {
+                abort();
+            }
+        }
+    }
+
+    // Against a prefix, a prefix with its last byte changed, and the
+    // substring, each compared both ways
+    std::string prefix = ref.substr(0, len);
+    std::string changed = prefix;
+    if (!changed.empty()) { changed.back() ^= 1; }
+    const std::string* others[] = {&prefix, &changed, &ref_sub};
+    for (const std::string* other : others) {
+        StringView o(*other);
+        bool starts = n >= other->size() && ref.compare(0, other->size(), *other) == 0;
+        if (view.starts_with(o) != starts) {
+            abort();
+        }
+        if ((view == o) != (ref == *other) || (view != o) == (ref == *other)) {
+            abort();
+        }
+        if (sign(view.compare(o)) != reference_compare(ref, *other) ||
+            sign(o.compare(view)) != reference_compare(*other, ref)) {
+            abort();
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static Fixture* fixture = new Fixture();
+    if (size == 0) {
+        return 0;
+    }
+    uint8_t settings = data[0];
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+
+    // Tokens are copied out so each is null terminated, as in a real argv
+    std::string buf;
+    if (settings & 0x80) {
+        const uint8_t* q = p;
+        while (q < end && *q != 0xff) { q++; }
+        buf.assign((const char*)(q < end ? q + 1 : q), (const char*)end);
+    } else {
+        buf.assign((const char*)p, (const char*)end);
+    }
+    const char* argv[max_tokens + 1] = {"fuzz"};
+    int argc = 1;
+    for (size_t start = 0; start <= buf.size() && argc <= (int)max_tokens; ) {
+        size_t nul = buf.find('\0', start);
+        if (nul == std::string::npos) { nul = buf.size(); }
+        argv[argc++] = buf.c_str() + start;
+        start = nul + 1;
+    }
+
+    // Suggestions point into the state, so results are checked while it lives
+    ParseState state(true);
+    if (settings & 0x80) {
+        parse_fresh(p, end, argc, argv);
+    } else if (settings & 0x40) {
+        check(fixture->tool.parse(argc, argv, state));
+    } else if (settings & 0x20) {
+        // Whitespace-split source over the raw bytes
+        fixture->plain.enable_abbreviations(settings & 1);
+        BufferSource source(StringView::from_range((const char*)p, (const char*)end));
+        check(fixture->plain.parse(source, state));
+    } else {
+        fixture->plain.enable_abbreviations(settings & 1);
+        Result res = fixture->plain.parse(argc, argv, state);
+        check(res);
+        if (res) {
+            check(fixture->plain.validate_all(state));
+            if (!fixture->pos) { abort(); }
+            int64_t out;
+            if (fixture->lazy) { fixture->lazy.get(out); }
+        }
+    }
+
+    check_string_view((const char*)p, (const char*)end);
+    return 0;
+}
+
+
+#if !defined(ARGS_LIBFUZZER)
+
+// Random inputs built from tokens the parser treats specially, plus random
+// bytes, so most inputs get past the first token.
+static void generate(std::mt19937_64& rng, std::vector<uint8_t>& out) {
+    static const char* const dict[] = {
+        "--int", "--int=", "-i", "-i7", "--double", "-d", "1e308", "-1e-400", "nan", "inf",
+        "--u64", "18446744073709551615", "18446744073709551616", "-u", "--string", "-s",
+        "--view=", "--lazy", "-l", "--float-value", "--float", "--ver", "--verbose",
+        "--version", "-v", "-vv", "--", "-", "--help", "-h", "--he", "--args-complete",
+        "commit", "checkout", "comit", "push", "--depth", "-d3", "--all", "-a", "-q",
+        "0", "1", "-1", "2147483648", "-2147483649", "0x10", " 12 ", "'a b'", "\"q\\\"\"",
+        "=", "==", "--=", "---", "--i", "-=", "@file", "",
+    };
+    const size_t dict_size = sizeof(dict) / sizeof(dict[0]);
+
+    out.clear();
+    out.push_back((uint8_t)rng());
+    if (out[0] & 0x80) {
+        size_t n = rng() % 8;
+        for (size_t i = 0; i < 3 * n; i++) { out.push_back((uint8_t)(rng() % 255)); }
+        out.push_back(0xff);
+    }
+    size_t tokens = rng() % 12;
+    for (size_t t = 0; t < tokens; t++) {
+        if (t) { out.push_back(out[0] & 0x20 ? ' ' : 0); }
+        if (rng() % 8 == 0) {
+            size_t n = rng() % 6;
+            for (size_t i = 0; i < n; i++) { out.push_back((uint8_t)rng()); }
+        } else {
+            const char* tok = dict[rng() % dict_size];
+            out.insert(out.end(), tok, tok + strlen(tok));
+        }
+    }
+}
+
+static bool read_file(const char* path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    out.clear();
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        out.insert(out.end(), chunk, chunk + n);
+    }
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint64_t iterations = 10000000;
+    uint64_t seed = 1;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    std::vector<uint8_t> input;
+    if (!files.empty()) {
+        for (const char* path : files) {
+            if (!read_file(path, input)) {
+                fprintf(stderr, "can't read %s\n", path);
+                return 1;
+            }
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+            printf("%s: ok\n", path);
+        }
+        return 0;
+    }
+
+    std::mt19937_64 rng(seed);
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {
+        generate(rng, input);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%llu inputs in %.2f s: %.2f M execs/s\n", (unsigned long long)iterations, secs, iterations / secs / 1e6);
+    return 0;
+}
+
+#endif
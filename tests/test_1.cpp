@@ -1,7 +1,13 @@
 
 #include <string>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <random>
 #include <cassert>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include "args.hpp"
 
@@ -288,6 +294,1696 @@ void test24() {
     printf("%s: ok\n", __func__);
 }
 
+void test30() {
+    const char* argv[] = {"", "--hex", "0x7f", "--oct=0o17", "-b0b101", "--big", "18446744073709551615", "--", "-42"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    PosArg<int> pos(parser, "num", "positional argument");
+    KVArg<long> hex(parser, "hex", "", "hex argument");
+    KVArg<short> oct(parser, "oct", "", "octal argument");
+    KVArg<unsigned> bin(parser, "bin", "b", "binary argument");
+    KVArg<uint64_t> big(parser, "big", "", "big argument");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(*pos == -42);
+    assert(*hex == 127);
+    assert(*oct == 15);
+    assert(*bin == 5);
+    assert(*big == 18446744073709551615ull);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test31() {
+    int8_t i8 = 0;
+    assert(Converter<int8_t>::parse("-128", i8) && i8 == -128);
+    assert(Converter<int8_t>::parse("+127", i8) && i8 == 127);
+    assert(!Converter<int8_t>::parse("128", i8));
+    assert(!Converter<int8_t>::parse("-129", i8));
+
+    int64_t i64 = 0;
+    assert(Converter<int64_t>::parse("-9223372036854775808", i64) && i64 == INT64_MIN);
+    assert(!Converter<int64_t>::parse("9223372036854775808", i64));
+    assert(!Converter<int64_t>::parse("99999999999999999999999", i64));
+
+    unsigned u = 1;
+    assert(Converter<unsigned>::parse("-0", u) && u == 0);
+    assert(!Converter<unsigned>::parse("-1", u));
+    assert(Converter<unsigned>::parse("0XfF", u) && u == 255);
+    assert(Converter<unsigned>::parse("010", u) && u == 10);
+
+    int i = 0;
+    assert(!Converter<int>::parse("", i));
+    assert(!Converter<int>::parse("-", i));
+    assert(!Converter<int>::parse("0x", i));
+    assert(!Converter<int>::parse("0b102", i));
+    assert(!Converter<int>::parse("12 ", i));
+    assert(!Converter<int>::parse("1.5", i));
+
+    printf("%s: ok\n", __func__);
+}
+
+struct Point { int x = 0, y = 0; };
+
+namespace args {
+template<>
+struct Converter<Point> {
+    static bool parse(StringView str, Point& val) {
+        auto comma = str.find(',');
+        if (comma == StringView::npos) { return false; }
+        return Converter<int>::parse(str.substr(0, comma), val.x)
+            && Converter<int>::parse(str.substr(comma + 1), val.y);
+    }
+};
+}
+
+void test32() {
+    const char* argv[] = {"", "--at", "3,-4", "c"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    KVArg<Point> at(parser, "at", "", "point argument");
+    PosArg<char> ch(parser, "ch", "char argument");
+
+    auto res = parser.parse();
+    assert(res);
+    assert((*at).x == 3 && (*at).y == -4);
+    assert(*ch == 'c');
+
+    printf("%s: ok\n", __func__);
+}
+
+void test33() {
+    const char* argv[] = {"", "two words", "--name=", "-s", "a b", "x", "y z"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    PosArg<StringView> pos(parser, "pos", "view argument");
+    KVArg<std::string> name(parser, "name", "", "string argument");
+    KVArg<StringView> space(parser, "space", "s", "view argument");
+    VarArg<StringView> rest(parser, "rest", "view arguments");
+
+    auto res = parser.parse();
+    assert(res);
+
+    // Views point straight into argv
+    assert((*pos).data() == argv[1] && *pos == "two words");
+    assert(name && (*name).empty());
+    assert((*space).data() == argv[4]);
+    assert((*rest).size() == 2 && (*rest)[0].data() == argv[5] && (*rest)[1] == "y z");
+
+    // std::string takes the whole value too, not just its first word
+    const char* argv2[] = {"", "--name", "a b c"};
+    argc = std::end(argv2) - std::begin(argv2);
+
+    Parser parser2("test", argc, argv2, true);
+    KVArg<std::string> name2(parser2, "name", "", "string argument");
+
+    res = parser2.parse();
+    assert(res);
+    assert(*name2 == "a b c");
+
+    printf("%s: ok\n", __func__);
+}
+
+// Counts conversions, to see when lazy arguments convert
+struct Counted { int n = 0; };
+static int g_conversions = 0;
+
+namespace args {
+template<>
+struct Converter<Counted> {
+    static bool parse(StringView str, Counted& val) {
+        g_conversions++;
+        return Converter<int>::parse(str, val.n);
+    }
+};
+}
+
+void test34() {
+    const char* argv[] = {"", "--a", "1", "--b=x", "-c", "3"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    LazyKVArg<Counted> a(parser, "a", "", "lazy argument");
+    LazyKVArg<Counted> b(parser, "b", "", "lazy argument");
+    LazyKVArg<Counted> c(parser, "c", "c", "lazy argument");
+    LazyKVArg<Counted> d(parser, "d", "", "lazy argument");
+
+    // Nothing converts while parsing, so the bad value isn't an error yet
+    g_conversions = 0;
+    auto res = parser.parse();
+    assert(res);
+    assert(g_conversions == 0);
+
+    // Converted once, on first access
+    assert((*a).n == 1);
+    assert(a.value().n == 1);
+    assert(g_conversions == 1);
+    assert(b.raw() == "x");
+
+    Counted val;
+    assert(!b.get(val));
+    assert(b.status() == Status::ISTREAM_ERROR);
+    assert(b.value_or(Counted()).n == 0);
+    assert(g_conversions == 2);
+
+    assert(!d && d.value_or(Counted()).n == 0);
+
+    res = parser.validate_all();
+    assert(res.status == Status::ISTREAM_ERROR);
+    assert(res.item == "b");
+    assert(g_conversions == 2);
+    assert((*c).n == 3);
+    assert(g_conversions == 3);
+
+    // A reparse forgets the cached values
+    const char* argv2[] = {"", "--b", "2"};
+    argc = std::end(argv2) - std::begin(argv2);
+    ParseState state(true);
+    res = parser.parse(argc, argv2, state);
+    assert(res && parser.validate_all(state));
+    assert(!a && (*b).n == 2);
+
+    // Tokens from a pipe don't outlive the scan, so they convert right away
+    int fds[2];
+    assert(pipe(fds) == 0);
+    const char* text = "--a 5 --b y";
+    assert(write(fds[1], text, strlen(text)) == (ssize_t)strlen(text));
+    close(fds[1]);
+    FdSource source(fds[0], 4);
+    g_conversions = 0;
+    res = parser.parse(source, state);
+    assert(res);
+    assert(g_conversions == 2);
+    assert((*a).n == 5 && b.status() == Status::ISTREAM_ERROR);
+    close(fds[0]);
+
+    // ... and keep their text, though the buffer has been reused since
+    assert(pipe(fds) == 0);
+    text = "--a 12345 --b bbbbb --c 7";
+    assert(write(fds[1], text, strlen(text)) == (ssize_t)strlen(text));
+    close(fds[1]);
+    FdSource source2(fds[0], 8);
+    res = parser.parse(source2, state);
+    assert(res);
+    assert(a.raw() == "12345" && b.raw() == "bbbbb" && c.raw() == "7");
+    assert((*a).n == 12345 && (*c).n == 7);
+    close(fds[0]);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test35() {
+    const char* envp[] = {"APP_PORT=8080", "APP_HOST=example.org", "APP_VERBOSE=Yes", "APP_DRY=0",
+                          "APP_PORT=1", "APP_RATE=fast", "NO_EQUALS", nullptr};
+
+    Schema schema("test");
+    KVArg<int> port(schema, "port", "p", "port");
+    KVArg<std::string> host(schema, "host", "", "host");
+    KVArg<int> retries(schema, "retries", "", "retries");
+    KVArg<double> rate(schema, "rate", "", "rate");
+    FlagArg verbose(schema, "verbose", "v", "verbose");
+    FlagArg dry(schema, "dry", "", "dry run");
+    port.set_env("APP_PORT");
+    host.set_env("APP_HOST");
+    retries.set_env("APP_RETRIES");
+    verbose.set_env("APP_VERBOSE");
+    dry.set_env("APP_DRY");
+
+    ParseState state(true);
+    state.set_environ(envp);
+
+    // argv over env over default; the first of duplicate names wins
+    const char* argv[] = {"", "--host", "localhost"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res);
+    assert(*port == 8080);
+    assert(*host == "localhost");
+    assert(!retries && retries.value_or(3) == 3);
+    assert(verbose && !dry);
+
+    const char* argv2[] = {"", "-p", "9", "--dry"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = schema.parse(argc, argv2, state);
+    assert(res);
+    assert(*port == 9 && *host == "example.org" && dry);
+
+    // Env values go through the same conversion as argv values
+    rate.set_env("APP_RATE");
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::ISTREAM_ERROR);
+    assert(res.item == "APP_RATE");
+
+    const char* bad_flag[] = {"APP_VERBOSE=maybe", nullptr};
+    state.set_environ(bad_flag);
+    rate.set_env(nullptr);
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::ISTREAM_ERROR);
+    assert(res.item == "APP_VERBOSE");
+
+    // The process environment, by default
+    setenv("ARGS_TEST_RETRIES", "5", 1);
+    const char* argv3[] = {""};
+    argc = std::end(argv3) - std::begin(argv3);
+    Parser parser("test", argc, argv3, true);
+    KVArg<int> retries2(parser, "retries", "", "retries");
+    retries2.set_env("ARGS_TEST_RETRIES");
+    res = parser.parse();
+    assert(res && *retries2 == 5);
+    unsetenv("ARGS_TEST_RETRIES");
+
+    // ... as it is at each parse, not when the state was made. Enough new
+    // variables that the block is reallocated, too.
+    ParseState later(true);
+    res = parser.parse(argc, argv3, later);
+    assert(res && !retries2);
+    setenv("ARGS_TEST_RETRIES", "8080", 1);
+    for (int i = 0; i < 256; i++) {
+        setenv(("ARGS_TEST_FILL_" + std::to_string(i)).c_str(), "x", 1);
+    }
+    res = parser.parse(argc, argv3, later);
+    assert(res && *retries2 == 8080);
+    unsetenv("ARGS_TEST_RETRIES");
+    for (int i = 0; i < 256; i++) {
+        unsetenv(("ARGS_TEST_FILL_" + std::to_string(i)).c_str());
+    }
+    res = parser.parse(argc, argv3, later);
+    assert(res && !retries2);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test40() {
+    const char* argv[] = {"", "--lr", "3e-4", "--threshold=0.1", "1.5", "-inf", "0x1.8p1"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    KVArg<double> lr(parser, "lr", "", "learning rate");
+    KVArg<float> threshold(parser, "threshold", "t", "threshold");
+    VarArg<float> vals(parser, "vals", "values");
+
+    auto res = parser.parse();
+    assert(!res);
+    assert(res.status == Status::INVALID_KEY);
+
+    const char* argv2[] = {"", "--lr", "3e-4", "--threshold=0.1", "1.5", "--", "-inf", "0x1.8p1"};
+    argc = std::end(argv2) - std::begin(argv2);
+
+    Parser parser2("test", argc, argv2, true);
+    KVArg<double> lr2(parser2, "lr", "", "learning rate");
+    KVArg<float> threshold2(parser2, "threshold", "t", "threshold");
+    VarArg<float> vals2(parser2, "vals", "values");
+
+    res = parser2.parse();
+    assert(res);
+    assert(*lr2 == 3e-4);
+    assert(*threshold2 == 0.1f);
+    assert((*vals2).size() == 3);
+    assert((*vals2)[0] == 1.5f);
+    assert(std::isinf((*vals2)[1]) && (*vals2)[1] < 0);
+    assert((*vals2)[2] == 3.0f);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test41() {
+    double d = 0;
+    assert(Converter<double>::parse("1.", d) && d == 1.0);
+    assert(Converter<double>::parse(".25", d) && d == 0.25);
+    assert(Converter<double>::parse("-0", d) && d == 0 && std::signbit(d));
+    assert(Converter<double>::parse("1E+2", d) && d == 100.0);
+    assert(Converter<double>::parse("Infinity", d) && std::isinf(d));
+    assert(Converter<double>::parse("NaN", d) && std::isnan(d));
+    assert(Converter<double>::parse("0x1p-1074", d) && d == 4.9406564584124654e-324);
+    assert(Converter<double>::parse("0X.8", d) && d == 0.5);
+    assert(Converter<double>::parse("1e-400", d) && d == 0);
+    assert(Converter<double>::parse("2.2250738585072011e-308", d) && d == 2.2250738585072011e-308);
+
+    assert(!Converter<double>::parse("", d));
+    assert(!Converter<double>::parse(".", d));
+    assert(!Converter<double>::parse("1e", d));
+    assert(!Converter<double>::parse("1.5x", d));
+    assert(!Converter<double>::parse("1,5", d));
+    assert(!Converter<double>::parse(" 1", d));
+    assert(!Converter<double>::parse("infx", d));
+    assert(!Converter<double>::parse("0x", d));
+    assert(!Converter<double>::parse("1e309", d));
+    assert(!Converter<double>::parse("0x1p1024", d));
+
+    float f = 0;
+    assert(Converter<float>::parse("3.4028235e38", f) && f == 3.4028235e38f);
+    assert(!Converter<float>::parse("3.5e38", f));
+    assert(Converter<float>::parse("1.4e-45", f) && f == 1.4e-45f);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test42() {
+    // Compare against strtod (the test runs in the "C" locale) on round trips
+    // and on long random digit strings that exercise the slow path.
+    std::mt19937_64 rng(42);
+    char buf[128];
+
+    for (int i = 0; i < 200000; i++) {
+        uint64_t bits = rng();
+        double x;
+        memcpy(&x, &bits, sizeof(x));
+        if (std::isnan(x) || std::isinf(x)) { continue; }
+
+        const char* fmts[] = {"%.17g", "%.15g", "%.6g", "%a"};
+        snprintf(buf, sizeof(buf), fmts[i % 4], x);
+
+        double expect = strtod(buf, nullptr);
+        double got = 0;
+        assert(Converter<double>::parse(buf, got));
+        assert(memcmp(&got, &expect, sizeof(got)) == 0);
+
+        float expectf = strtof(buf, nullptr);
+        float gotf = 0;
+        if (std::isinf(expectf)) {
+            assert(!Converter<float>::parse(buf, gotf));
+        } else {
+            assert(Converter<float>::parse(buf, gotf));
+            assert(memcmp(&gotf, &expectf, sizeof(gotf)) == 0);
+        }
+    }
+
+    for (int i = 0; i < 20000; i++) {
+        int len = 0;
+        int ndigits = 1 + (int)(rng() % 40);
+        for (int j = 0; j < ndigits; j++) {
+            buf[len++] = (char)('0' + rng() % 10);
+            if (j == ndigits / 2) { buf[len++] = '.'; }
+        }
+        len += snprintf(buf + len, sizeof(buf) - len, "e%d", (int)(rng() % 700) - 350 - ndigits / 2);
+
+        double expect = strtod(buf, nullptr);
+        double got = 0;
+        if (std::isinf(expect)) {
+            assert(!Converter<double>::parse(buf, got));
+        } else {
+            assert(Converter<double>::parse(buf, got));
+            assert(memcmp(&got, &expect, sizeof(got)) == 0);
+        }
+
+        float expectf = strtof(buf, nullptr);
+        float gotf = 0;
+        if (std::isinf(expectf)) {
+            assert(!Converter<float>::parse(buf, gotf));
+        } else {
+            assert(Converter<float>::parse(buf, gotf));
+            assert(memcmp(&gotf, &expectf, sizeof(gotf)) == 0);
+        }
+    }
+
+    printf("%s: ok\n", __func__);
+}
+
+static int scalar_sign(const std::string& a, const std::string& b) {
+    for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+        if (a[i] != b[i]) { return a[i] - b[i] < 0 ? -1 : 1; }
+    }
+    if (a.size() == b.size()) { return 0; }
+    return a.size() < b.size() ? 1 : -1;
+}
+
+static int sign(int x) { return (x > 0) - (x < 0); }
+
+void test50() {
+    // Lengths straddle the 16 and 32 byte vector widths
+    for (size_t len = 0; len < 80; len++) {
+        std::string a(len, 'k');
+        assert(StringView(a) == StringView(a.c_str(), 0, len));
+        assert(StringView(a).find('=') == StringView::npos);
+
+        for (size_t i = 0; i < len; i++) {
+            std::string b = a;
+            b[i] = '=';
+            assert(StringView(b).find('=') == i);
+            assert(StringView(b).find('=', i + 1) == StringView::npos);
+            assert(StringView(b) != StringView(a));
+            assert(sign(StringView(a).compare(b)) == scalar_sign(a, b));
+            assert(sign(StringView(b).compare(a)) == scalar_sign(b, a));
+            assert(StringView(b).starts_with(StringView(a.c_str(), 0, i)));
+            assert(!StringView(b).starts_with(a));
+
+            std::string prefix = a.substr(0, i);
+            assert(sign(StringView(a).compare(prefix)) == scalar_sign(a, prefix));
+            assert(sign(StringView(prefix).compare(a)) == scalar_sign(prefix, a));
+        }
+    }
+
+    std::string hi = "key\x80";
+    std::string lo = "key\x01";
+    assert(sign(StringView(hi).compare(lo)) == scalar_sign(hi, lo));
+
+    StringView kv("--key=value");
+    assert(kv.starts_with("--"));
+    assert(kv.substr(2, kv.find('=') - 2) == "key");
+    assert(kv.substr(kv.find('=') + 1) == "value");
+    assert(kv.substr(kv.size()) == "");
+
+    printf("%s: ok\n", __func__);
+}
+
+void test60() {
+    static const auto keys = make_key_table("kv", "flag", "other");
+    assert(keys.valid());
+
+    const char* argv[] = {"", "--kv", "3", "--flag", "--kv=4"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    parser.set_key_table(keys);
+    KVArg<int> kv(parser, "kv", "k", "key-value argument");
+    FlagArg flag(parser, "flag", "f", "flag argument");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(*kv == 4);
+    assert(flag);
+
+    // "other" is in the table but was never registered
+    const char* argv2[] = {"", "--other", "--kv", "3"};
+    argc = std::end(argv2) - std::begin(argv2);
+
+    Parser parser2("test", argc, argv2, true);
+    parser2.set_key_table(keys);
+    KVArg<int> kv2(parser2, "kv", "k", "key-value argument");
+
+    res = parser2.parse();
+    assert(!res);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.item == "other");
+
+    const char* argv3[] = {"", "--nope"};
+    argc = std::end(argv3) - std::begin(argv3);
+
+    Parser parser3("test", argc, argv3, true);
+    parser3.set_key_table(keys);
+    KVArg<int> kv3(parser3, "kv", "k", "key-value argument");
+
+    res = parser3.parse();
+    assert(!res);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.item == "nope");
+
+    printf("%s: ok\n", __func__);
+}
+
+void test61() {
+    assert(!make_key_table("a", "b", "a").valid());
+
+    static const KeyTable<6> table("alpha", "beta", "gamma", "delta", "epsilon", "zeta");
+    assert(table.valid());
+    for (size_t i = 0; i < table.size(); i++) {
+        assert(table.find(table.key(i)) == (long)i);
+    }
+    assert(table.find("alph") == -1);
+    assert(table.find("alphaa") == -1);
+    assert(table.find("") == -1);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test70() {
+    const char* argv[] = {"", "-a", "-n7", "-\xff", "x", "-b", "-n", "8", "-q"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    FlagArg a(parser, "a", "a", "flag argument");
+    FlagArg b(parser, "b", "b", "flag argument");
+    FlagArg c(parser, "c", "c", "flag argument");
+    KVArg<int> n(parser, "n", "n", "key-value argument");
+    KVArg<std::string> high(parser, "high", "\xff", "key-value argument");
+
+    auto res = parser.parse();
+    assert(!res);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.item == "q");
+    assert(a && b && !c);
+    assert(*n == 8);
+    assert(*high == "x");
+
+    const char* argv2[] = {"", "-ax"};
+    argc = std::end(argv2) - std::begin(argv2);
+
+    Parser parser2("test", argc, argv2, true);
+    FlagArg a2(parser2, "a", "a", "flag argument");
+
+    res = parser2.parse();
+    assert(res.status == Status::EXTRA_VALUE);
+    assert(res.item == "a");
+
+    printf("%s: ok\n", __func__);
+}
+
+void test80() {
+    const char* buf = "  pos --kv val\n-f\t1 2   3 ";
+    BufferSource source(buf);
+
+    Parser parser("test", source, true);
+    PosArg<std::string> pos(parser, "pos", "positional argument");
+    KVArg<std::string> key(parser, "kv", "k", "key-value argument");
+    FlagArg flag(parser, "flag", "f", "flag argument");
+    VarArg<int> nums(parser, "nums", "numbers");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(*pos == "pos");
+    assert(*key == "val");
+    assert(flag);
+    assert((*nums).size() == 3 && (*nums)[2] == 3);
+
+    BufferSource source2("--kv");
+    Parser parser2("test", source2, true);
+    KVArg<std::string> key2(parser2, "kv", "k", "key-value argument");
+    res = parser2.parse();
+    assert(res.status == Status::MISSING_VALUE);
+    assert(res.item == "kv");
+
+    printf("%s: ok\n", __func__);
+}
+
+void test81() {
+    // A long stream through a tiny buffer: every token straddles a refill
+    // at some point, and memory stays at the buffer size.
+    FILE* f = tmpfile();
+    assert(f);
+    const int n = 200000;
+    for (int i = 0; i < n; i++) {
+        fprintf(f, i % 3 ? "--num %d " : "-n%d\n", i);
+    }
+    fprintf(f, "--name   last");
+    fflush(f);
+    rewind(f);
+
+    FdSource source(fileno(f), 32);
+    Parser parser("test", source, true);
+    KVArg<int> num(parser, "num", "n", "key-value argument");
+    KVArg<std::string> name(parser, "name", "", "key-value argument");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(!source.failed());
+    assert(*num == n - 1);
+    assert(*name == "last");
+    fclose(f);
+
+    // A token that can't fit in the buffer fails the stream
+    int fds[2];
+    assert(pipe(fds) == 0);
+    const char* text = "--num 1 --name 0123456789abcdefghijklmnopqrstuvwxyz";
+    assert(write(fds[1], text, strlen(text)) == (ssize_t)strlen(text));
+    close(fds[1]);
+
+    FdSource source2(fds[0], 16);
+    Parser parser2("test", source2, true);
+    KVArg<int> num2(parser2, "num", "n", "key-value argument");
+    KVArg<std::string> name2(parser2, "name", "", "key-value argument");
+
+    res = parser2.parse();
+    assert(res.status == Status::SOURCE_ERROR);
+    assert(source2.failed());
+    assert(*num2 == 1);
+    close(fds[0]);
+
+    printf("%s: ok\n", __func__);
+}
+
+static std::string write_temp(const std::string& contents) {
+    char path[] = "/tmp/args_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, contents.data(), contents.size()) == (ssize_t)contents.size());
+    close(fd);
+    return path;
+}
+
+void test90() {
+    std::string text = "a\"b c\"d 'e f'\t\"x\\\"y\" \\ z \"\"\n";
+    char* cur = &text[0];
+    char* end = cur + text.size();
+    StringView tok;
+    bool open;
+
+    assert(detail::next_quoted_token(cur, end, tok, open) && tok == "ab cd");
+    assert(detail::next_quoted_token(cur, end, tok, open) && tok == "e f");
+    assert(detail::next_quoted_token(cur, end, tok, open) && tok == "x\"y");
+    assert(detail::next_quoted_token(cur, end, tok, open) && tok == " z");
+    assert(detail::next_quoted_token(cur, end, tok, open) && tok == "");
+    assert(!detail::next_quoted_token(cur, end, tok, open) && !open);
+
+    // A quote left open is malformed, not a token running to the end
+    const char* bad[] = {"a \"bc", "'x y\n", "\"a\\\"", "ok \"\\\""};
+    for (const char* b : bad) {
+        std::string t = b;
+        cur = &t[0];
+        end = cur + t.size();
+        while (detail::next_quoted_token(cur, end, tok, open)) {}
+        assert(open);
+    }
+
+    printf("%s: ok\n", __func__);
+}
+
+void test91() {
+    std::string inner = write_temp("'1' \\2\n\n");
+    std::string empty = write_temp("");
+    std::string outer = write_temp("pos --num \"4\"2 @" + empty + " -f @" + inner + " --name=\"x\"y");
+    std::string outer_arg = "@" + outer;
+
+    const char* argv[] = {"", outer_arg.c_str(), "3", "--", "@4"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    parser.enable_response_files();
+    PosArg<std::string> pos(parser, "pos", "positional argument");
+    KVArg<int> num(parser, "num", "n", "key-value argument");
+    KVArg<std::string> name(parser, "name", "", "key-value argument");
+    FlagArg flag(parser, "flag", "f", "flag argument");
+    VarArg<std::string> rest(parser, "rest", "the rest");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(*pos == "pos");
+    assert(*num == 42);
+    assert(*name == "xy");
+    assert(flag);
+    assert((*rest).size() == 4);
+    assert((*rest)[0] == "1" && (*rest)[1] == "2" && (*rest)[2] == "3" && (*rest)[3] == "@4");
+
+    // Without enable_response_files, @ is just a character
+    Parser parser2("test", argc, argv, true);
+    VarArg<std::string> rest2(parser2, "rest", "the rest");
+    res = parser2.parse();
+    assert(res);
+    assert((*rest2)[0] == outer_arg);
+
+    unlink(inner.c_str());
+    unlink(empty.c_str());
+    unlink(outer.c_str());
+
+    printf("%s: ok\n", __func__);
+}
+
+void test92() {
+    // a -> b -> a
+    std::string a = write_temp("");
+    std::string b = write_temp("1 @" + a);
+    FILE* f = fopen(a.c_str(), "w");
+    fprintf(f, "0 @%s", b.c_str());
+    fclose(f);
+
+    std::string arg = "@" + a;
+    const char* argv[] = {"", arg.c_str()};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    parser.enable_response_files();
+    VarArg<int> nums(parser, "nums", "numbers");
+
+    auto res = parser.parse();
+    assert(res.status == Status::RESPONSE_FILE_ERROR);
+    assert(res.item == a);
+    assert((*nums).size() == 2);
+
+    const char* argv2[] = {"", "@/nonexistent/args_test"};
+    argc = std::end(argv2) - std::begin(argv2);
+    Parser parser2("test", argc, argv2, true);
+    parser2.enable_response_files();
+    res = parser2.parse();
+    assert(res.status == Status::RESPONSE_FILE_ERROR);
+    assert(res.item == "/nonexistent/args_test");
+
+    // An unterminated quote fails the parse, naming the file, rather than
+    // swallowing the rest of it
+    std::string open = write_temp("--name \"abc\n--num 5\n");
+    std::string open_arg = "@" + open;
+    const char* argv3[] = {"", open_arg.c_str()};
+    argc = std::end(argv3) - std::begin(argv3);
+    Schema schema("test");
+    schema.enable_response_files();
+    KVArg<std::string> name(schema, "name", "", "key-value argument");
+    KVArg<int> num(schema, "num", "", "key-value argument");
+    ParseState state(true);
+    res = schema.parse(argc, argv3, state);
+    assert(res.status == Status::RESPONSE_FILE_ERROR);
+    assert(res.item == open);
+    assert(!name && !num);
+
+    // ... wherever the bad token falls, and with a path read from a pipe
+    std::string late = write_temp("--num 5 'x");
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::string text = "--name a @" + late + " " + std::string(64, 'z');
+    assert(write(fds[1], text.data(), text.size()) == (ssize_t)text.size());
+    close(fds[1]);
+    VarArg<std::string> rest(schema, "rest", "varargs");
+    FdSource source(fds[0], 48);
+    res = schema.parse(source, state);
+    assert(res.status == Status::RESPONSE_FILE_ERROR);
+    assert(res.item == late);
+    assert(*name == "a" && *num == 5 && !rest);
+    close(fds[0]);
+
+    unlink(a.c_str());
+    unlink(b.c_str());
+    unlink(open.c_str());
+    unlink(late.c_str());
+
+    printf("%s: ok\n", __func__);
+}
+
+void test93() {
+    std::string path = write_temp("--name 'a b' \"c\\\"d\" e");
+    std::string arg = "@" + path;
+    const char* argv[] = {"", arg.c_str()};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    parser.enable_response_files();
+    KVArg<StringView> name(parser, "name", "", "view argument");
+    VarArg<StringView> rest(parser, "rest", "view arguments");
+
+    // Quotes and escapes are removed in the mapping, which views point into
+    auto res = parser.parse();
+    assert(res);
+    assert(*name == "a b");
+    assert((*rest).size() == 2 && (*rest)[0] == "c\"d" && (*rest)[1] == "e");
+
+    unlink(path.c_str());
+
+    printf("%s: ok\n", __func__);
+}
+
+void test94() {
+    std::string path = write_temp(
+        "# tuning\n"
+        "threads = 4\n"
+        "  rate=0.25  \r\n"
+        "\n"
+        "name = a = b\n"
+        "verbose\n"
+        "dry = off\n"
+        "threads = 8\n"
+        "port=1");
+
+    Schema schema("test");
+    KVArg<int> threads(schema, "threads", "t", "threads");
+    KVArg<double> rate(schema, "rate", "", "rate");
+    KVArg<StringView> name(schema, "name", "", "name");
+    KVArg<int> port(schema, "port", "", "port");
+    FlagArg verbose(schema, "verbose", "v", "verbose");
+    FlagArg dry(schema, "dry", "", "dry run");
+    port.set_env("APP_PORT");
+
+    const char* envp[] = {"APP_PORT=2", nullptr};
+    ParseState state(true);
+    state.set_environ(envp);
+    state.set_config_file(path.c_str());
+
+    // File, then env, then argv; within the file the last line wins
+    const char* argv[] = {"", "--dry"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res);
+    assert(*threads == 8 && *rate == 0.25 && *name == "a = b");
+    assert(*port == 2);
+    assert(verbose && dry);
+
+    const char* argv2[] = {"", "-t", "1"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = schema.parse(argc, argv2, state);
+    assert(res);
+    assert(*threads == 1 && !dry);
+
+    // Errors name the key and line
+    std::string bad = write_temp("threads = 2\n\n  bogus = 1\n");
+    state.set_config_file(bad.c_str());
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.item == "bogus" && res.line == 3);
+
+    std::string bad2 = write_temp("rate\nthreads = x\n");
+    state.set_config_file(bad2.c_str());
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::MISSING_VALUE && res.item == "rate" && res.line == 1);
+
+    // Values the command line overrides aren't converted
+    std::string bad3 = write_temp("threads = x\nrate = y\n");
+    state.set_config_file(bad3.c_str());
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::ISTREAM_ERROR && res.item == "rate" && res.line == 2);
+
+    state.set_config_file("/nonexistent/args_test");
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::CONFIG_FILE_ERROR);
+
+    // Through Parser, and with an empty file
+    std::string empty = write_temp("");
+    Parser parser("test", argc, argv2, true);
+    KVArg<int> threads2(parser, "threads", "t", "threads");
+    parser.set_config_file(empty.c_str());
+    res = parser.parse();
+    assert(res && *threads2 == 1);
+
+    unlink(path.c_str());
+    unlink(bad.c_str());
+    unlink(bad2.c_str());
+    unlink(bad3.c_str());
+    unlink(empty.c_str());
+
+    printf("%s: ok\n", __func__);
+}
+
+void test100() {
+    Schema schema("test");
+    PosArg<int> pos(schema, "pos", "a positional");
+    KVArg<int> kv(schema, "kv", "k", "a key");
+    FlagArg flag(schema, "flag", "f", "a flag");
+    VarArg<int> rest(schema, "rest", "the rest");
+    ParseState state(true);
+
+    const char* argv[] = {"", "1", "--kv", "2", "-f", "3", "4"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res);
+    assert(*pos == 1 && *kv == 2 && *flag);
+    assert((*rest == std::vector<int>{3, 4}));
+
+    // Nothing carries over from the first parse
+    const char* argv2[] = {"", "5"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = schema.parse(argc, argv2, state);
+    assert(res);
+    assert(*pos == 5 && !kv && !flag && !rest);
+    assert((*rest).empty());
+
+    // Including the positional index and "--"
+    const char* argv3[] = {"", "--", "-6"};
+    argc = std::end(argv3) - std::begin(argv3);
+    res = schema.parse(argc, argv3, state);
+    assert(res);
+    assert(*pos == -6);
+
+    const char* argv4[] = {"", "-k", "7"};
+    argc = std::end(argv4) - std::begin(argv4);
+    res = schema.parse(argc, argv4, state);
+    assert(res.status == Status::MISSING_ARG);
+    assert(*kv == 7 && !pos);
+
+    // A separate state, and a token source, against the same schema
+    ParseState state2(true);
+    BufferSource source("8 --kv=9 10");
+    res = schema.parse(source, state2);
+    assert(res);
+    assert(*pos == 8 && *kv == 9 && (*rest == std::vector<int>{10}));
+
+    printf("%s: ok\n", __func__);
+}
+
+void test101() {
+    Schema schema("test");
+    PosArg<int> pos(schema, "pos", "a positional");
+    KVArg<int> kv(schema, "kv", "k", "a key");
+    KVArg<double> ratio(schema, "ratio", "", "a ratio");
+    FlagArg flag(schema, "flag", "f", "a flag");
+    VarArg<int> rest(schema, "rest", "the rest");
+
+    std::vector<std::vector<std::string>> storage;
+    std::mt19937 rng(101);
+    for (int i = 0; i < 5000; i++) {
+        std::vector<std::string> line = {"test", std::to_string(i)};
+        if (rng() % 2) { line.push_back("--kv"); line.push_back(std::to_string(rng() % 1000)); }
+        if (rng() % 2) { line.push_back("-f"); }
+        if (rng() % 3 == 0) { line.push_back("--ratio=" + std::to_string(i) + ".5"); }
+        for (unsigned n = rng() % 4; n > 0; n--) { line.push_back(std::to_string(rng() % 100)); }
+        switch (rng() % 50) {
+            case 0: line.push_back("--bogus"); break;
+            case 1: line.push_back("--kv"); line.push_back("x"); break;
+            case 2: line.resize(1); break;
+        }
+        storage.push_back(line);
+    }
+
+    std::vector<std::vector<const char*>> argvs;
+    std::vector<CommandLine> lines;
+    for (auto& line : storage) {
+        argvs.emplace_back();
+        for (auto& s : line) { argvs.back().push_back(s.c_str()); }
+    }
+    for (auto& argv : argvs) {
+        lines.push_back(CommandLine{(int)argv.size(), argv.data()});
+    }
+
+    for (unsigned threads : {1u, 3u, 8u}) {
+        ThreadPool pool(threads);
+        // Twice, to reuse the pool
+        for (int rep = 0; rep < 2; rep++) {
+            BatchResult batch = schema.parse_batch(lines, pool);
+            assert(batch.size() == lines.size());
+
+            ParseState state(true);
+            for (size_t i = 0; i < lines.size(); i++) {
+                auto res = schema.parse(lines[i].argc, lines[i].argv, state);
+                assert(batch[i].status == res.status);
+                assert(batch[i].item == res.item);
+                if (!res) { continue; }
+
+                assert(batch.value_or(i, pos, -1) == *pos);
+                assert(batch.found(i, kv) == kv.found());
+                assert(batch.value_or(i, kv, -1) == kv.value_or(-1));
+                assert(batch.value_or(i, ratio, -1.0) == ratio.value_or(-1.0));
+                assert(batch.found(i, flag) == *flag);
+
+                std::vector<int> vals;
+                for (const BatchValue* v = batch.begin(i); v != batch.end(i); v++) {
+                    if (v->arg == rest.get_id()) {
+                        vals.push_back(atoi(v->text().str().c_str()));
+                    }
+                }
+                assert(vals == *rest);
+            }
+        }
+    }
+
+    // Response files are never opened
+    schema.enable_response_files();
+    const char* argv[] = {"", "1", "@/nonexistent/args_test"};
+    CommandLine line = {3, argv};
+    ThreadPool pool(2);
+    BatchResult batch = schema.parse_batch(&line, 1, pool);
+    assert(batch[0].status == Status::RESPONSE_FILE_ERROR);
+    assert(batch[0].item == "/nonexistent/args_test");
+
+    batch = schema.parse_batch(&line, 0, pool);
+    assert(batch.size() == 0);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test102() {
+    std::vector<std::string> storage;
+    std::mt19937 rng(102);
+    for (int i = 0; i < 100000; i++) {
+        storage.push_back(std::to_string(rng() % 100000) + "." + std::to_string(rng() % 1000));
+    }
+    storage[0] = "7";
+    std::vector<const char*> argv(1, "test");
+    for (auto& s : storage) { argv.push_back(s.c_str()); }
+
+    ThreadPool pool(4);
+    ThreadPool* pools[] = {nullptr, &pool};
+    for (ThreadPool* p : pools) {
+        Schema schema("test");
+        PosArg<int> first(schema, "first", "first");
+        VarArg<double> rest(schema, "rest", "the rest");
+        schema.enable_deferred_varargs(p);
+        ParseState state(true);
+
+        auto res = schema.parse((int)argv.size(), argv.data(), state);
+        assert(res);
+        assert((*rest).size() == storage.size() - 1);
+        assert((*rest).capacity() == (*rest).size());
+        for (size_t i = 1; i < storage.size(); i++) {
+            assert((*rest)[i - 1] == strtod(storage[i].c_str(), nullptr));
+        }
+
+        // Only the values before the first bad one are kept
+        std::vector<const char*> bad = argv;
+        bad[70002] = "x";
+        bad[90002] = "y";
+        res = schema.parse((int)bad.size(), bad.data(), state);
+        assert(res.status == Status::ISTREAM_ERROR);
+        assert(res.item == "rest");
+        assert((*rest).size() == 70000);
+
+        // Even when a later token is an error of its own
+        const char* argv2[] = {"", "1", "2", "x", "3", "--bogus"};
+        int argc = std::end(argv2) - std::begin(argv2);
+        res = schema.parse(argc, argv2, state);
+        assert(res.status == Status::ISTREAM_ERROR);
+        assert((*rest == std::vector<double>{2}));
+
+        const char* argv3[] = {"", "1", "2", "3", "--bogus"};
+        argc = std::end(argv3) - std::begin(argv3);
+        res = schema.parse(argc, argv3, state);
+        assert(res.status == Status::INVALID_KEY);
+        assert((*rest == std::vector<double>{2, 3}));
+
+        // Tokens from a pipe don't stay valid, so they're converted as read
+        int fds[2];
+        assert(pipe(fds) == 0);
+        const char* text = "1 2.5 3.5";
+        assert(write(fds[1], text, strlen(text)) == (ssize_t)strlen(text));
+        close(fds[1]);
+        FdSource source(fds[0], 4);
+        res = schema.parse(source, state);
+        assert(res);
+        assert((*rest == std::vector<double>{2.5, 3.5}));
+        close(fds[0]);
+    }
+
+    printf("%s: ok\n", __func__);
+}
+
+void test103() {
+    Schema schema("tool");
+    PosArg<int> in(schema, "input", "Input id");
+    KVArg<int> threads(schema, "threads", "t", "Worker threads");
+    FlagArg verbose(schema, "verbose", "v", "Chatty");
+
+    StringView text = schema.usage_text();
+    assert(text ==
+        "USAGE:\n"
+        "\ttool:  [OPTIONS] [FLAGS] <input> \n"
+        "\n"
+        "ARGS:\n"
+        "\tinput                Input id\n"
+        "\n"
+        "OPTIONS:\n"
+        "\t--threads, -t <val>  Worker threads\n"
+        "\n"
+        "FLAGS:\n"
+        "\t--verbose, -v        Chatty\n"
+        "\t--help, -h           Print help message\n");
+
+    // Cached until an argument is added
+    assert(schema.usage_text().data() == text.data());
+    KVArg<std::string> out(schema, "output-directory", "", "Where results go");
+    text = schema.usage_text();
+    assert(text.str().find("\t--output-directory <val>  Where results go\n") != std::string::npos);
+    assert(text.str().find("\t--help, -h                Print help message\n") != std::string::npos);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test104() {
+    Schema schema("my-tool");
+    KVArg<int> threads(schema, "threads", "t", "Worker threads");
+    KVArg<int> thread_stack(schema, "thread-stack", "", "Stack size");
+    KVArg<std::string> output(schema, "output", "o", "Output path");
+    FlagArg verbose(schema, "verbose", "v", "Chatty");
+    FlagArg ver(schema, "ver", "", "Print version");
+    ParseState state(true);
+
+    // Off by default
+    const char* argv[] = {"", "--out", "x"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res.status == Status::INVALID_KEY);
+
+    schema.enable_abbreviations();
+    res = schema.parse(argc, argv, state);
+    assert(res);
+    assert(*output == "x");
+
+    const char* argv2[] = {"", "--verb", "--thread-s=2"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = schema.parse(argc, argv2, state);
+    assert(res);
+    assert(*verbose && !ver && *thread_stack == 2);
+
+    // An exact key beats the longer keys it's a prefix of
+    const char* argv3[] = {"", "--ver", "--threads", "3"};
+    argc = std::end(argv3) - std::begin(argv3);
+    res = schema.parse(argc, argv3, state);
+    assert(res);
+    assert(*ver && !verbose && *threads == 3);
+
+    const char* argv4[] = {"", "--thr", "3"};
+    argc = std::end(argv4) - std::begin(argv4);
+    res = schema.parse(argc, argv4, state);
+    assert(res.status == Status::AMBIGUOUS_KEY);
+    assert(res.item == "thr");
+
+    FlagArg hello(schema, "hello", "", "Greet");
+    const char* argv6[] = {"", "--he"};
+    argc = std::end(argv6) - std::begin(argv6);
+    res = schema.parse(argc, argv6, state);
+    assert(res.status == Status::AMBIGUOUS_KEY);
+    const char* argv7[] = {"", "--hell"};
+    argc = std::end(argv7) - std::begin(argv7);
+    res = schema.parse(argc, argv7, state);
+    assert(res);
+    assert(*hello);
+
+    // An empty key abbreviates nothing
+    const char* argv8[] = {"", "--=x"};
+    argc = std::end(argv8) - std::begin(argv8);
+    res = schema.parse(argc, argv8, state);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.item == "");
+
+    // Completion
+    StringView out[8];
+    size_t n = schema.complete("thr", out, 8);
+    assert(n == 2 && out[0] == "thread-stack" && out[1] == "threads");
+    n = schema.complete("", out, 2);
+    assert(n == 6 && out[0] == "hello" && out[1] == "output");
+    assert(schema.complete("x", out, 8) == 0);
+
+    // Adding an argument rebuilds the index
+    FlagArg throttle(schema, "throttle", "", "Slow down");
+    assert(schema.complete("thr", out, 8) == 3 && out[2] == "throttle");
+
+    const char* argv5[] = {"", "--args-complete", "x"};
+    argc = std::end(argv5) - std::begin(argv5);
+    res = schema.parse(argc, argv5, state);
+    assert(res.status == Status::INVALID_KEY);
+    schema.enable_completion();
+    res = schema.parse(argc, argv5, state);
+    assert(res.status == Status::COMPLETED);
+
+    std::string bash = schema.completion_script(Shell::BASH);
+    assert(bash.find("_args_complete_my_tool() {") != std::string::npos);
+    assert(bash.find("--args-complete \"$cur\" \"${COMP_WORDS[@]:1:COMP_CWORD-1}\"") != std::string::npos);
+    assert(bash.find("complete -o default -F _args_complete_my_tool my-tool\n") != std::string::npos);
+    std::string zsh = schema.completion_script(Shell::ZSH);
+    assert(zsh.find("#compdef my-tool\n") == 0);
+    assert(zsh.find("--args-complete \"${words[CURRENT]}\" \"${(@)words[2,CURRENT-1]}\"") != std::string::npos);
+    assert(zsh.find("compdef _args_complete_my_tool my-tool\n") != std::string::npos);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test105() {
+    Schema schema("test");
+    KVArg<int> threads(schema, "threads", "t", "Worker threads");
+    KVArg<int> thread_stack(schema, "thread-stack", "", "Stack size");
+    KVArg<std::string> output(schema, "output", "o", "Output path");
+    FlagArg verbose(schema, "verbose", "v", "Chatty");
+    FlagArg version(schema, "version", "", "Print version");
+    ParseState state(true);
+
+    const char* argv[] = {"", "--thred", "1"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.suggestion_count == 1 && res.suggestions[0] == "threads");
+
+    // Nearest first
+    const char* argv2[] = {"", "--versoin"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = schema.parse(argc, argv2, state);
+    assert(res.status == Status::INVALID_KEY);
+    assert(res.suggestion_count == 2);
+    assert(res.suggestions[0] == "version" && res.suggestions[1] == "verbose");
+
+    // Too far from anything
+    const char* argv3[] = {"", "--quiet"};
+    argc = std::end(argv3) - std::begin(argv3);
+    res = schema.parse(argc, argv3, state);
+    assert(res.status == Status::INVALID_KEY && res.suggestion_count == 0);
+
+    // Nothing on success
+    const char* argv4[] = {"", "--threads", "2"};
+    argc = std::end(argv4) - std::begin(argv4);
+    res = schema.parse(argc, argv4, state);
+    assert(res && res.suggestion_count == 0);
+
+    StringView out[Result::max_suggestions];
+    assert(schema.suggest("hlep", out, 3) == 1 && out[0] == "help");
+    assert(schema.suggest("thread-stak", out, 1) == 1 && out[0] == "thread-stack");
+    assert(schema.suggest("", out, 3) == 0);
+
+    printf("%s: ok\n", __func__);
+}
+
+static int g_built_commits = 0;
+static int g_built_pushes = 0;
+
+struct Commit {
+    KVArg<std::string> message;
+    FlagArg amend;
+    explicit Commit(Schema& schema)
+    : message(schema, "message", "m", "Commit message"),
+      amend(schema, "amend", "", "Replace the last commit") {
+        g_built_commits++;
+    }
+};
+
+struct Push {
+    PosArg<std::string> remote;
+    FlagArg force;
+    explicit Push(Schema& schema)
+    : remote(schema, "remote", "Where to push"),
+      force(schema, "force", "f", "Overwrite") {
+        g_built_pushes++;
+    }
+};
+
+struct Remote {
+    Subcommand<Push> add;
+    explicit Remote(Schema& schema) : add(schema, "add", "Add a remote") {}
+};
+
+void test106() {
+    Schema git("git");
+    FlagArg verbose(git, "verbose", "v", "Chatty");
+    Subcommand<Commit> commit(git, "commit", "Record changes");
+    Subcommand<Push> push(git, "push", "Update a remote");
+    Subcommand<Remote> remote(git, "remote", "Manage remotes");
+    ParseState state(true);
+
+    // Only the selected subcommand is built
+    const char* argv[] = {"", "-v", "commit", "-m", "fix", "--amend"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = git.parse(argc, argv, state);
+    assert(res);
+    assert(*verbose && commit && !push && !remote);
+    assert(commit->message.value() == "fix" && *commit->amend);
+    assert(g_built_commits == 1 && g_built_pushes == 0);
+
+    // Options after the subcommand are its own
+    const char* argv2[] = {"", "push", "origin", "-v"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = git.parse(argc, argv2, state);
+    assert(res.status == Status::INVALID_KEY);
+
+    const char* argv3[] = {"", "push", "-f", "origin"};
+    argc = std::end(argv3) - std::begin(argv3);
+    res = git.parse(argc, argv3, state);
+    assert(res);
+    assert(!verbose && !commit && push);
+    assert(push->remote.value() == "origin" && *push->force);
+
+    // Built once, then reused
+    const char* argv4[] = {"", "commit"};
+    argc = std::end(argv4) - std::begin(argv4);
+    res = git.parse(argc, argv4, state);
+    assert(res);
+    assert(commit && !commit->message && !commit->amend);
+    assert(g_built_commits == 1 && g_built_pushes == 1);
+
+    // Nested
+    const char* argv5[] = {"", "remote", "add", "upstream"};
+    argc = std::end(argv5) - std::begin(argv5);
+    res = git.parse(argc, argv5, state);
+    assert(res);
+    assert(remote && remote->add && remote->add->remote.value() == "upstream");
+
+    const char* argv6[] = {"", "comit"};
+    argc = std::end(argv6) - std::begin(argv6);
+    res = git.parse(argc, argv6, state);
+    assert(res.status == Status::INVALID_COMMAND && res.item == "comit");
+    assert(res.suggestion_count == 1 && res.suggestions[0] == "commit");
+
+    const char* argv7[] = {"", "-v"};
+    argc = std::end(argv7) - std::begin(argv7);
+    res = git.parse(argc, argv7, state);
+    assert(res.status == Status::MISSING_ARG);
+
+    // A subcommand's own errors
+    const char* argv8[] = {"", "push"};
+    argc = std::end(argv8) - std::begin(argv8);
+    res = git.parse(argc, argv8, state);
+    assert(res.status == Status::MISSING_ARG);
+
+    // Past a few rehashes
+    Schema tool("tool");
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; i++) {
+        names.push_back("command-" + std::to_string(i));
+    }
+    std::vector<std::unique_ptr<Subcommand<Commit>>> commands;
+    for (auto& name : names) {
+        commands.emplace_back(new Subcommand<Commit>(tool, name.c_str(), ""));
+    }
+    for (int i = 0; i < 100; i += 33) {
+        const char* argv9[] = {"", names[i].c_str(), "-m", "x"};
+        argc = std::end(argv9) - std::begin(argv9);
+        res = tool.parse(argc, argv9, state);
+        assert(res);
+        assert(*commands[i] && (*commands[i])->message.value() == "x");
+    }
+
+    StringView text = git.usage_text();
+    assert(text.str().find("[FLAGS] <command> ...\n") != std::string::npos);
+    assert(text.str().find("COMMANDS:\n\tcommit         Record changes\n") != std::string::npos);
+
+    printf("%s: ok\n", __func__);
+}
+
+struct Job {
+    int threads = 1;
+    bool verbose = false;
+    std::string name;
+};
+
+void test107() {
+    // Built at run time under C++11; see test_2 for the compile-time checks
+    auto schema = make_struct_schema<Job>("job",
+        kv_field("threads", "t", &Job::threads, "Worker threads"),
+        flag_field("verbose", "v", &Job::verbose, "Chatty"),
+        pos_field("name", &Job::name, "Job name"));
+    assert(schema.valid());
+
+    const char* argv[] = {"", "nightly", "-t8", "--verbose"};
+    int argc = std::end(argv) - std::begin(argv);
+    Job job;
+    auto res = schema.parse(argc, argv, job, true);
+    assert(res);
+    assert(job.threads == 8 && job.verbose && job.name == "nightly");
+
+    auto bad = make_struct_schema<Job>("job",
+        kv_field("threads", "t", &Job::threads, ""),
+        flag_field("threads", "", &Job::verbose, ""));
+    assert(!bad.valid() && strcmp(bad.error(), "two fields have the same key") == 0);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test108() {
+    Schema schema("test");
+    schema.enable_no_exit();
+    KVArg<int> kv(schema, "kv", "k", "a key");
+    FlagArg dup(schema, "kv", "", "same long key");
+    FlagArg help(schema, "verbose", "h", "reserved short key");
+    FlagArg flag(schema, "flag", "f", "a flag");
+    assert(strcmp(schema.config_error_message(), "Parser config error: config kv's key is a duplicate") == 0);
+
+    // Nothing parses, and nothing is printed even without a silent state
+    ParseState state;
+    const char* argv[] = {"", "--kv", "1"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res.status == Status::CONFIG_ERROR);
+    assert(res.item == schema.config_error_message());
+    assert(!kv);
+
+    // The arguments that were fine were added, the others weren't
+    Schema good("test");
+    good.enable_no_exit();
+    KVArg<int> kv2(good, "kv", "k", "a key");
+    FlagArg flag2(good, "flag", "f", "a flag");
+    assert(good.config_error_message() == nullptr);
+
+    const char* argv2[] = {"", "--kv", "x", "--help", "--bogus"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = good.parse(argc, argv2, state);
+    assert(res.status == Status::ISTREAM_ERROR);
+    const char* argv3[] = {"", "-f", "--help"};
+    argc = std::end(argv3) - std::begin(argv3);
+    res = good.parse(argc, argv3, state);
+    assert(res.status == Status::HELP && *flag2);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test109() {
+    Schema schema("test");
+    PosArg<int> pos(schema, "pos", "a positional");
+    KVArg<int> num(schema, "num", "n", "an int");
+    KVArg<double> ratio(schema, "ratio", "r", "a double");
+    KVArg<std::string> name(schema, "name", "", "a string");
+    LazyKVArg<int> lazy(schema, "lazy", "", "a lazy int");
+    FlagArg flag(schema, "flag", "f", "a flag");
+    VarArg<std::string> rest(schema, "rest", "the rest");
+
+    ParseStats stats;
+    ParseState state(true);
+    state.set_stats(&stats);
+
+    const char* argv[] = {"", "7", "--num", "1", "--ratio=0.5", "-n2", "-f", "--name", "abcd", 
+                          "--lazy", "3", "x", "--", "--yz"};
+    int argc = std::end(argv) - std::begin(argv);
+    auto res = schema.parse(argc, argv, state);
+    assert(res && *num == 2 && *name == "abcd" && rest.value().size() == 2);
+
+    assert(stats.parses == 1);
+    assert(stats.tokens[(size_t)TokenKind::LONG] == 3);
+    assert(stats.tokens[(size_t)TokenKind::LONG_EQ] == 1);
+    assert(stats.tokens[(size_t)TokenKind::SHORT] == 2);
+    assert(stats.tokens[(size_t)TokenKind::VALUE] == 3);
+    assert(stats.tokens[(size_t)TokenKind::POSITIONAL] == 1);
+    assert(stats.tokens[(size_t)TokenKind::VARARG] == 2);
+    assert(stats.tokens[(size_t)TokenKind::DOUBLE_DASH] == 1);
+    assert(stats.total_tokens() == (size_t)argc - 1);
+
+    // Four long keys, each found on the first probe, and two short ones
+    assert(stats.lookups == 6 && stats.probes == 6);
+    assert(stats.conversions[(size_t)ValueType::INTEGER] == 3);
+    assert(stats.conversions[(size_t)ValueType::FLOAT] == 1);
+    assert(stats.conversions[(size_t)ValueType::STRING] == 3);
+    assert(stats.conversions[(size_t)ValueType::LAZY] == 1);
+    assert(stats.conversion_failures == 0);
+    assert(stats.bytes_copied == 4 + 1 + 4);
+    assert(stats.usage_ns == 0);
+
+    // Counts add up until reset
+    const char* bad[] = {"", "1", "--num", "x"};
+    argc = std::end(bad) - std::begin(bad);
+    res = schema.parse(argc, bad, state);
+    assert(res.status == Status::ISTREAM_ERROR);
+    assert(stats.parses == 2 && stats.conversion_failures == 1);
+    assert(stats.conversions[(size_t)ValueType::INTEGER] == 5);
+
+    stats.reset();
+    assert(stats.parses == 0 && stats.total_tokens() == 0 && stats.lookups == 0);
+
+    // Without stats nothing is counted
+    state.set_stats(nullptr);
+    res = schema.parse(argc, bad, state);
+    assert(stats.parses == 0 && stats.total_conversions() == 0);
+
+    // Deferred vararg tokens are kept in the state, which allocates once and
+    // then reuses its storage
+    Schema deferred("test");
+    VarArg<int> ints(deferred, "ints", "ints");
+    deferred.enable_deferred_varargs();
+    state.set_stats(&stats);
+    const char* many[] = {"", "1", "2", "3", "4", "5", "6", "7", "8", "9"};
+    argc = std::end(many) - std::begin(many);
+    assert(deferred.parse(argc, many, state) && ints.value().size() == 9);
+    uint64_t first = stats.allocations;
+    assert(first > 0);
+    assert(deferred.parse(argc, many, state));
+    assert(stats.allocations == first);
+    assert(stats.conversions[(size_t)ValueType::INTEGER] == 18);
+
+    // Counted only while stats are set; either way allocations reach the
+    // state's resource, and the counts agree
+    CountingResource heap;
+    ParseState own(heap, true);
+    assert(deferred.parse(argc, many, own));
+    uint64_t before = heap.allocations();
+    assert(before > 0);
+    stats.reset();
+    own.set_stats(&stats);
+    assert(deferred.parse(argc, many, own));
+    assert(stats.allocations > 0 && stats.allocations == heap.allocations() - before);
+    own.set_stats(nullptr);
+    assert(deferred.parse(argc, many, own) && ints.value().size() == 9);
+    assert(stats.parses == 1);
+
+    // Setting stats leaves the last parse's values alone, even those that
+    // point into a mapped config file
+    std::string path = write_temp("name = from-config\n");
+    Schema configured("test");
+    KVArg<StringView> view(configured, "name", "", "a view");
+    ParseState plain(true);
+    plain.set_config_file(path.c_str());
+    const char* none[] = {""};
+    assert(configured.parse(1, none, plain) && *view == "from-config");
+    plain.set_stats(&stats);
+    assert(*view == "from-config");
+    assert(configured.parse(1, none, plain) && *view == "from-config");
+    plain.set_stats(nullptr);
+    assert(*view == "from-config");
+    unlink(path.c_str());
+
+    printf("%s: ok\n", __func__);
+}
+
+void test110() {
+    // A token longer than the buffer is an error, not the end of the input:
+    // --n after it isn't quietly dropped
+    int fds[2];
+    assert(pipe(fds) == 0);
+    std::string text = "a b " + std::string(100, 'x') + " --n 7";
+    assert(write(fds[1], text.data(), text.size()) == (ssize_t)text.size());
+    close(fds[1]);
+
+    FdSource source(fds[0], 32);
+    Schema schema("test");
+    KVArg<int> n(schema, "n", "", "key-value argument");
+    VarArg<std::string> rest(schema, "rest", "varargs");
+
+    ParseState state(true);
+    auto res = schema.parse(source, state);
+    assert(res.status == Status::SOURCE_ERROR);
+    assert(source.failed());
+    assert(!n.found());
+    close(fds[0]);
+
+    // A read error, reading a directory
+    int dir = open(".", O_RDONLY);
+    assert(dir >= 0);
+    FdSource source2(dir, 32);
+    res = schema.parse(source2, state);
+    assert(res.status == Status::SOURCE_ERROR);
+    assert(source2.failed());
+    close(dir);
+
+    assert(strcmp(status_str[(int)Status::SOURCE_ERROR], "SOURCE_ERROR") == 0);
+
+    printf("%s: ok\n", __func__);
+}
+
+// Runs f with stderr going to a temporary file, and returns what it wrote
+template<typename F>
+static std::string capture(FILE* stream, F f) {
+    fflush(stream);
+    FILE* tmp = tmpfile();
+    assert(tmp);
+    int fd = fileno(stream);
+    int saved = dup(fd);
+    dup2(fileno(tmp), fd);
+    f();
+    fflush(stream);
+    dup2(saved, fd);
+    close(saved);
+
+    std::string out;
+    rewind(tmp);
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), tmp)) > 0) {
+        out.append(buf, n);
+    }
+    fclose(tmp);
+    return out;
+}
+
+static size_t count_of(const std::string& s, const char* what) {
+    size_t n = 0;
+    for (size_t i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) {
+        n++;
+    }
+    return n;
+}
+
+void test111() {
+    // Deferred varargs stop the parse at a bad value, as converting one at a
+    // time does: nothing after it is applied or reported
+    ThreadPool pool(4);
+    ThreadPool* pools[] = {nullptr, &pool};
+    for (ThreadPool* p : pools) {
+        Schema schema("test");
+        KVArg<int> n(schema, "n", "n", "key-value argument");
+        FlagArg verbose(schema, "verbose", "v", "flag");
+        VarArg<int> rest(schema, "rest", "varargs");
+        schema.enable_deferred_varargs(p);
+        ParseState state(true);
+
+        const char* argv[] = {"", "1", "bad", "-n", "5", "--verbose"};
+        int argc = std::end(argv) - std::begin(argv);
+        auto res = schema.parse(argc, argv, state);
+        assert(res.status == Status::ISTREAM_ERROR);
+        assert(res.item == "rest");
+        assert(!n.found());
+        assert(!verbose.found());
+        assert((*rest == std::vector<int>{1}));
+
+        // Runs between keys convert in order
+        const char* argv2[] = {"", "1", "2", "-n", "5", "3", "--verbose", "4"};
+        argc = std::end(argv2) - std::begin(argv2);
+        res = schema.parse(argc, argv2, state);
+        assert(res);
+        assert(*n == 5);
+        assert(verbose.found());
+        assert((*rest == std::vector<int>{1, 2, 3, 4}));
+
+        // One error, with usage printed once, and no help
+        ParseState loud;
+        const char* argv3[] = {"", "bad", "--help"};
+        argc = std::end(argv3) - std::begin(argv3);
+        std::string err = capture(stderr, [&] {
+            res = schema.parse(argc, argv3, loud);
+        });
+        assert(res.status == Status::ISTREAM_ERROR);
+        assert(count_of(err, "USAGE") == 1);
+        assert(count_of(err, "Could not parse vararg") == 1);
+    }
+
+    printf("%s: ok\n", __func__);
+}
+
+void test112() {
+    // Completion is asked for by the first word alone, and the words before
+    // the cursor after it never reach the arguments
+    Schema tool("tool");
+    KVArg<std::string> name(tool, "name", "", "Name");
+    VarArg<std::string> rest(tool, "rest", "Rest");
+    tool.enable_completion();
+    ParseState state(true);
+
+    const char* argv[] = {"", "--args-complete", "", "--name"};
+    int argc = std::end(argv) - std::begin(argv);
+    Result res(Status::SUCCESS, "");
+    std::string out = capture(stdout, [&] {
+        res = tool.parse(argc, argv, state);
+    });
+    assert(res.status == Status::COMPLETED);
+    assert(!name);
+    assert(out == "--name\n--help\n");
+
+    const char* argv2[] = {"", "--args-complete", "x", "--", "y"};
+    argc = std::end(argv2) - std::begin(argv2);
+    out = capture(stdout, [&] {
+        res = tool.parse(argc, argv2, state);
+    });
+    assert(res.status == Status::COMPLETED);
+    assert(rest.value().empty());
+    assert(out == "");
+
+    // Anywhere else the key means nothing special
+    const char* argv3[] = {"", "--name", "--args-complete", "x"};
+    argc = std::end(argv3) - std::begin(argv3);
+    out = capture(stdout, [&] {
+        res = tool.parse(argc, argv3, state);
+    });
+    assert(res);
+    assert(*name == "--args-complete" && rest.value().size() == 1);
+    assert(out == "");
+    const char* argv4[] = {"", "x", "--args-complete=y"};
+    argc = std::end(argv4) - std::begin(argv4);
+    res = tool.parse(argc, argv4, state);
+    assert(res.status == Status::INVALID_KEY);
+
+    // Subcommand names are walked, and the last one completes its own keys
+    Schema git("git");
+    FlagArg verbose(git, "verbose", "v", "Chatty");
+    Subcommand<Commit> commit(git, "commit", "Record changes");
+    Subcommand<Remote> remote(git, "remote", "Manage remotes");
+    git.enable_completion();
+
+    const char* argv5[] = {"", "--args-complete=--", "-v", "remote", "add"};
+    argc = std::end(argv5) - std::begin(argv5);
+    out = capture(stdout, [&] {
+        res = git.parse(argc, argv5, state);
+    });
+    assert(res.status == Status::COMPLETED);
+    assert(!verbose);
+    assert(out == "--force\n--help\n");
+
+    const char* argv6[] = {"", "--args-complete", "", "remote"};
+    argc = std::end(argv6) - std::begin(argv6);
+    out = capture(stdout, [&] {
+        res = git.parse(argc, argv6, state);
+    });
+    assert(res.status == Status::COMPLETED);
+    assert(out == "add\n--help\n");
+
+    printf("%s: ok\n", __func__);
+}
+
 int main() {
 
     test1();
@@ -307,6 +2003,47 @@ int main() {
     test22();
     test23();
     test24();
+
+    test30();
+    test31();
+    test32();
+    test33();
+    test34();
+    test35();
+
+    test40();
+    test41();
+    test42();
+
+    test50();
+
+    test60();
+    test61();
+
+    test70();
+
+    test80();
+    test81();
+
+    test90();
+    test91();
+    test92();
+    test93();
+    test94();
+
+    test100();
+    test101();
+    test102();
+    test103();
+    test104();
+    test105();
+    test106();
+    test107();
+    test108();
+    test109();
+    test110();
+    test111();
+    test112();
 }
 
 
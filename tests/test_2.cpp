@@ -0,0 +1,131 @@
+#include <string>
+#include <cstdio>
+#include <cassert>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Features that need C++14 or later.
+
+#define KEYS_10(p) #p "0", #p "1", #p "2", #p "3", #p "4", #p "5", #p "6", #p "7", #p "8", #p "9"
+#define KEYS_100(p) KEYS_10(p##0), KEYS_10(p##1), KEYS_10(p##2), KEYS_10(p##3), KEYS_10(p##4), \
+    KEYS_10(p##5), KEYS_10(p##6), KEYS_10(p##7), KEYS_10(p##8), KEYS_10(p##9)
+
+static constexpr auto small_keys = make_key_table("kv", "flag");
+static_assert(small_keys.valid(), "small_keys");
+static_assert(!make_key_table("kv", "flag", "kv").valid(), "duplicates are detected");
+
+static constexpr auto big_keys = make_key_table(KEYS_100(opt_a), KEYS_100(opt_b), KEYS_100(opt_c));
+static_assert(big_keys.valid(), "big_keys");
+static_assert(big_keys.size() == 300, "big_keys");
+
+struct Opts {
+    int threads = 1;
+    double rate = 0.5;
+    bool verbose = false;
+    bool dry_run = false;
+    std::string input;
+    int count = 0;
+};
+
+static constexpr auto opts_schema = make_struct_schema<Opts>("tool",
+    kv_field("threads", "t", &Opts::threads, "Worker threads"),
+    kv_field("rate", "", &Opts::rate, "Sample rate"),
+    flag_field("verbose", "v", &Opts::verbose, "Chatty"),
+    flag_field("dry-run", "n", &Opts::dry_run, "Change nothing"),
+    pos_field("input", &Opts::input, "Input file"),
+    pos_field("count", &Opts::count, "How many"));
+static_assert(opts_schema.valid(), "opts_schema");
+
+static_assert(!make_struct_schema<Opts>("tool",
+    kv_field("threads", "t", &Opts::threads, ""),
+    kv_field("threads", "", &Opts::count, "")).valid(), "duplicate keys are detected");
+static_assert(!make_struct_schema<Opts>("tool",
+    kv_field("threads", "t", &Opts::threads, ""),
+    flag_field("verbose", "t", &Opts::verbose, "")).valid(), "duplicate short keys are detected");
+static_assert(!make_struct_schema<Opts>("tool",
+    flag_field("help", "", &Opts::verbose, "")).valid(), "help is reserved");
+static_assert(!make_struct_schema<Opts>("tool",
+    flag_field("verbose", "h", &Opts::verbose, "")).valid(), "h is reserved");
+
+
+void test1() {
+    const char* argv[] = {"", "--kv", "3", "--flag"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    parser.set_key_table(small_keys);
+    KVArg<int> kv(parser, "kv", "k", "key-value argument");
+    FlagArg flag(parser, "flag", "f", "flag argument");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(*kv == 3);
+    assert(flag);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test2() {
+    for (size_t i = 0; i < big_keys.size(); i++) {
+        assert(big_keys.find(big_keys.key(i)) == (long)i);
+    }
+    assert(big_keys.find("opt_a") == -1);
+    assert(big_keys.find("opt_a000") == -1);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test3() {
+    const char* argv[] = {"", "-t", "4", "in.txt", "--rate=0.25", "-v", "--", "-3"};
+    int argc = std::end(argv) - std::begin(argv);
+    Opts opts;
+    auto res = opts_schema.parse(argc, argv, opts, true);
+    assert(res);
+    assert(opts.threads == 4 && opts.rate == 0.25 && opts.verbose && !opts.dry_run);
+    assert(opts.input == "in.txt" && opts.count == -3);
+
+    const char* argv2[] = {"", "--threads", "x", "in", "1"};
+    argc = std::end(argv2) - std::begin(argv2);
+    res = opts_schema.parse(argc, argv2, opts, true);
+    assert(res.status == Status::ISTREAM_ERROR && res.item == "threads");
+
+    const char* argv3[] = {"", "--bogus", "in", "1"};
+    argc = std::end(argv3) - std::begin(argv3);
+    res = opts_schema.parse(argc, argv3, opts, true);
+    assert(res.status == Status::INVALID_KEY && res.item == "bogus");
+
+    const char* argv4[] = {"", "in"};
+    argc = std::end(argv4) - std::begin(argv4);
+    res = opts_schema.parse(argc, argv4, opts, true);
+    assert(res.status == Status::MISSING_ARG);
+
+    const char* argv5[] = {"", "-nv2", "in", "1"};
+    argc = std::end(argv5) - std::begin(argv5);
+    res = opts_schema.parse(argc, argv5, opts, true);
+    assert(res.status == Status::EXTRA_VALUE && res.item == "n");
+
+    const char* argv6[] = {"", "in", "1", "--rate"};
+    argc = std::end(argv6) - std::begin(argv6);
+    res = opts_schema.parse(argc, argv6, opts, true);
+    assert(res.status == Status::MISSING_VALUE && res.item == "rate");
+
+    const char* argv7[] = {"", "in", "1", "2"};
+    argc = std::end(argv7) - std::begin(argv7);
+    res = opts_schema.parse(argc, argv7, opts, true);
+    assert(res.status == Status::EXTRA_ARG);
+
+    const char* argv8[] = {"", "-h"};
+    argc = std::end(argv8) - std::begin(argv8);
+    res = opts_schema.parse(argc, argv8, opts, true);
+    assert(res.status == Status::HELP);
+
+    printf("%s: ok\n", __func__);
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+}
@@ -0,0 +1,159 @@
+#include <string>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+
+#include "args.hpp"
+#include "count_allocs.hpp"
+
+using namespace args;
+
+// Heap accounting. count_allocs.hpp replaces the global allocator for the
+// whole binary, so these tests live apart from test_1.
+
+void test1() {
+    const char* argv[] = {"", "7", "--count", "3", "--rate=0.5", "-v", "-t0x10", "--size", "-2e3"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    alignas(16) static char buf[16 * 1024];
+    Arena arena(buf, sizeof(buf), nullptr);
+
+    size_t before = g_allocs;
+    {
+        Parser parser("test", argc, argv, arena, true);
+        PosArg<long> pos(parser, "pos", "positional argument");
+        KVArg<int> count(parser, "count", "c", "key-value argument");
+        KVArg<double> rate(parser, "rate", "r", "key-value argument");
+        KVArg<unsigned> threads(parser, "threads", "t", "key-value argument");
+        KVArg<float> size(parser, "size", "", "key-value argument");
+        FlagArg verbose(parser, "verbose", "v", "flag argument");
+        FlagArg quiet(parser, "quiet", "q", "flag argument");
+
+        auto res = parser.parse();
+        assert(res);
+        assert(*pos == 7);
+        assert(*count == 3);
+        assert(*rate == 0.5);
+        assert(*threads == 16);
+        assert(*size == -2000.0f);
+        assert(verbose && !quiet);
+    }
+    assert(g_allocs == before);
+    assert(arena.remaining() < sizeof(buf));
+
+    printf("%s: ok\n", __func__);
+}
+
+void test2() {
+    // Error paths don't allocate either
+    const char* argv[] = {"", "--count", "x3", "--bogus"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    alignas(16) static char buf[16 * 1024];
+    Arena arena(buf, sizeof(buf), nullptr);
+
+    size_t before = g_allocs;
+    {
+        Parser parser("test", argc, argv, arena, true);
+        KVArg<int> count(parser, "count", "c", "key-value argument");
+
+        auto res = parser.parse();
+        assert(res.status == Status::ISTREAM_ERROR);
+        assert(res.item == "count");
+    }
+    assert(g_allocs == before);
+
+    printf("%s: ok\n", __func__);
+}
+
+void test3() {
+    // A full buffer spills over to upstream and is released with the arena
+    char buf[64];
+    size_t before = g_allocs;
+    {
+        Arena arena(buf, sizeof(buf));
+        void* a = arena.allocate(48, 8);
+        void* b = arena.allocate(48, 8);
+        assert((char*)a >= buf && (char*)a < buf + sizeof(buf));
+        assert(!((char*)b >= buf && (char*)b < buf + sizeof(buf)));
+        assert(g_allocs == before + 1);
+    }
+
+    printf("%s: ok\n", __func__);
+}
+
+void test4() {
+    // Borrowed strings don't allocate; only the VarArg's vector does
+    const char* argv[] = {"", "in.txt", "--out", "out dir/", "a", "b", "c"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    alignas(16) static char buf[16 * 1024];
+    Arena arena(buf, sizeof(buf), nullptr);
+
+    size_t before = g_allocs;
+    {
+        Parser parser("test", argc, argv, arena, true);
+        PosArg<StringView> in(parser, "in", "view argument");
+        KVArg<StringView> out(parser, "out", "o", "view argument");
+        VarArg<StringView> rest(parser, "rest", "view arguments");
+        parser.enable_deferred_varargs();
+
+        auto res = parser.parse();
+        assert(res);
+        assert(*in == "in.txt" && *out == "out dir/");
+        assert((*rest).size() == 3);
+        assert(g_allocs == before + 1);
+    }
+
+    printf("%s: ok\n", __func__);
+}
+
+struct Remote {
+    KVArg<std::string> url;
+    FlagArg force;
+    VarArg<int> ids;
+    explicit Remote(Schema& schema)
+    : url(schema, "url", "u", "key-value argument"), force(schema, "force", "f", "flag argument"),
+      ids(schema, "ids", "varargs") {}
+};
+
+void test5() {
+    // A subcommand's schema allocates from its parent's resource; only the
+    // schema and options objects themselves come from the heap
+    const char* argv[] = {"", "-v", "push", "-f", "--url", "x"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    alignas(16) static char buf[16 * 1024];
+    Arena arena(buf, sizeof(buf), nullptr);
+
+    Parser parser("test", argc, argv, arena, true);
+    FlagArg verbose(parser, "verbose", "v", "flag argument");
+    Subcommand<Remote> push(parser, "push", "subcommand");
+    Subcommand<Remote> pull(parser, "pull", "subcommand");
+
+    size_t before = g_allocs;
+    size_t remaining = arena.remaining();
+    auto res = parser.parse();
+    assert(res);
+    assert(verbose && push && !pull);
+    assert(push->force && push->url.value() == "x");
+    assert(g_allocs - before == 2);
+    assert(arena.remaining() < remaining);
+
+    // Built once
+    ParseState state(arena, true);
+    before = g_allocs;
+    assert(parser.parse(argc, argv, state));
+    assert(push->force && g_allocs == before);
+
+    printf("%s: ok\n", __func__);
+}
+
+int main() {
+    test1();
+    test2();
+    test3();
+    test4();
+    test5();
+}
@@ -0,0 +1,32 @@
+#include <string>
+#include <string_view>
+#include <cstdio>
+#include <cassert>
+
+#include "args.hpp"
+
+using namespace args;
+
+// Features that need C++17 or later.
+
+void test1() {
+    const char* argv[] = {"", "a path", "--name", "x y", "1", "2"};
+    int argc = std::end(argv) - std::begin(argv);
+
+    Parser parser("test", argc, argv, true);
+    PosArg<std::string_view> path(parser, "path", "view argument");
+    KVArg<std::string_view> name(parser, "name", "n", "view argument");
+    VarArg<std::string_view> rest(parser, "rest", "view arguments");
+
+    auto res = parser.parse();
+    assert(res);
+    assert(*path == "a path" && (*path).data() == argv[1]);
+    assert(*name == "x y");
+    assert((*rest).size() == 2 && (*rest)[1].data() == argv[5]);
+
+    printf("%s: ok\n", __func__);
+}
+
+int main() {
+    test1();
+}